@@ -0,0 +1,116 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#ifndef  ARROW__IPC
+#define  ARROW__IPC
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <table_store.hpp>
+
+namespace dbfsutils{
+
+// A flatbuffer written back to front, like the builder of the flatbuffers library: an object 
+// is written before the objects referring to it, and its position is counted from the end of
+// the buffer. The metadata of an Arrow file is made of a few small objects, so the bytes are
+// simply inserted at the head of a vector.
+
+class FlatBuilder{
+        public:
+                                 FlatBuilder(void);
+                uint32_t         size(void)                                          const noexcept(true);
+                uint32_t         text(const std::string& value)                            noexcept(false);
+                uint32_t         offsets(const std::vector<uint32_t>& items)               noexcept(false);
+                uint32_t         structs(const TableData& items, size_t count)             noexcept(false);
+                void             startTable(void)                                          noexcept(true);
+                void             offsetField(uint16_t slot, uint32_t target)               noexcept(false);
+                uint32_t         endTable(void)                                            noexcept(false);
+                void             finish(uint32_t root, TableData& out)                     noexcept(false);
+
+                template<typename T>
+                void             field(uint16_t slot, T value)                             noexcept(false){
+                                     scalar(value);
+                                     fields.push_back(FieldPos(slot, size()));
+                                 }
+
+        private:
+                typedef std::tuple<uint16_t, uint32_t>                  FieldPos;
+                enum FIELDPOSATTR { FSLOT, FPOS };
+
+                TableData                            buf;
+                std::vector<FieldPos>                fields;
+                uint32_t                             tableStart;
+
+                void             prep(size_t align, size_t extra)                          noexcept(false);
+                void             push(const void* data, size_t len)                        noexcept(false);
+                void             uoffset(uint32_t target)                                  noexcept(false);
+
+                template<typename T>
+                void             scalar(T value)                                           noexcept(false){
+                                     prep(sizeof(T), 0);
+                                     push(&value, sizeof(T));
+                                 }
+};
+
+// A table written as an Arrow IPC file, in a single record batch: the values are parsed from 
+// their text, by the PostgreSQL type of their column. Booleans, integers and floating point 
+// numbers have their own types, an empty value is null; the other types are kept as text 
+// (Utf8, LargeUtf8 over 2 GiB). The buffers are aligned to 8 bytes, so the file can be 
+// mapped by a reader and used in place.
+
+class ArrowWriter{
+        public:
+                enum PGTYPE      { PG_BOOL=16, PG_INT8=20, PG_INT2=21, PG_INT4=23, 
+                                   PG_FLOAT4=700, PG_FLOAT8=701 };
+
+                                 ArrowWriter(const ColumnNames& columnNames, const ColumnTypes& columnTypes);
+                void             append(size_t column, const char* text, size_t len)       noexcept(false);
+                void             endRow(void)                                              noexcept(false);
+                void             write(TableData& out)                               const noexcept(false);
+
+        private:
+                enum ARROWTYPE   { ARROW_UTF8, ARROW_BOOL, ARROW_INT16, ARROW_INT32, ARROW_INT64, 
+                                   ARROW_FLOAT32, ARROW_FLOAT64 };
+                enum ARROWCONST  { ALIGNMENT=8, METADATA_V5=4, TYPE_INT=2, TYPE_FLOAT=3, TYPE_UTF8=5,
+                                   TYPE_BOOL=6, TYPE_LARGE_UTF8=20, HEADER_SCHEMA=1, HEADER_BATCH=3 };
+
+                typedef std::tuple<ARROWTYPE, TableData, TableData, 
+                                   std::vector<int64_t>, int64_t>       Builder;
+                enum BUILDERATTR { BTYPE, BVALID, BVALUES, BOFFSETS, BNULLS };
+
+                ColumnNames                          names;
+                std::vector<Builder>                 columns;
+                int64_t                              rows;
+
+                static void      setBit(TableData& bits, int64_t index, bool value)        noexcept(false);
+                uint32_t         schema(FlatBuilder& fbb)                            const noexcept(false);
+                static void      message(TableData& out, const TableData& meta)            noexcept(false);
+                static void      padTo(TableData& out, size_t align)                       noexcept(false);
+                static void      putInt64(TableData& out, int64_t value)                   noexcept(false);
+};
+
+} // end namespace dbfsutils
+
+#endif
@@ -0,0 +1,103 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#ifndef  COLUMN__STORE
+#define  COLUMN__STORE
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <table_store.hpp>
+
+namespace dbfsutils{
+
+// The table rendered like in FlatStore, kept by column: the values of the boolean, integer,
+// floating point, date, time and timestamp columns in arrays of their binary type, with a
+// bit for the nulls, the values of the other columns in a heap of bytes with the end offset
+// of every value. The text is rendered again by the reads, in blocks of whole rows of about
+// 64 KiB; the last blocks rendered are kept in a small cache, like in BlockStore. A value is converted 
+// only if it's rendered back to the same bytes, otherwise its whole column is kept as text:
+// the file read is the same as the one loaded. The constructor throws invalid_argument when
+// the rows can't be split in a field for every column.
+
+class ColumnStore : public TableStore {
+        public:
+                enum COLUMNCONST { BLOCK_SIZE=65536, BLOCK_CACHE=4, VALUE_MAX=64 };
+
+                                 ColumnStore(const TableData& tdata, const ColumnTypes& columnTypes,
+                                             bool escaped=false);
+                size_t           size(void)                                      const noexcept(true)  override;
+                RowNum           rows(void)                                      const noexcept(true)  override;
+                size_t           read(char* buf, size_t len, size_t offset)      const noexcept(false) override;
+                size_t           memory(void)                                    const noexcept(true)  override;
+
+                size_t           typed(void)                                     const noexcept(true);
+
+        private:
+                enum VALUEKIND   { KIND_TEXT, KIND_BOOL, KIND_INT16, KIND_INT32, KIND_INT64, 
+                                   KIND_FLOAT32, KIND_FLOAT64, KIND_DATE, KIND_TIME, KIND_TIMESTAMP };
+                enum PGTYPE      { PG_BOOL=16, PG_INT8=20, PG_INT2=21, PG_INT4=23, PG_FLOAT4=700, 
+                                   PG_FLOAT8=701, PG_DATE=1082, PG_TIME=1083, PG_TIMESTAMP=1114 };
+
+                typedef std::tuple<VALUEKIND, TableData, std::vector<bool>,
+                                   RowIndex>                            Column;
+                enum COLUMNATTR  { CKIND, CVALUES, CNULLS, CENDS };
+                typedef std::tuple<size_t, unsigned long, TableData>    CachedBlock;
+                enum CACHEATTR   { CBLOCK, CTICK, CDATA };
+
+                std::vector<Column>                  columns;
+                std::vector<size_t>                  blocks;
+                std::vector<RowNum>                  firstRows;
+                size_t                               total;
+                RowNum                               rowNum;
+                mutable std::vector<CachedBlock>     cache;
+                mutable unsigned long                tick;
+                mutable std::mutex                   mtxCache;
+
+                void             append(Column& column, const char* text, size_t len)  noexcept(false);
+                void             demote(Column& column)                                noexcept(false);
+                void             putText(Column& column, const char* text, size_t len) noexcept(false);
+                size_t           value(const Column& column, RowNum row, char* out)
+                                                                                 const noexcept(true);
+                const TableData& block(size_t index)                             const noexcept(false);
+
+                static size_t    width(VALUEKIND kind)                                 noexcept(true);
+                static bool      encode(VALUEKIND kind, const char* text, size_t len,
+                                        char* bin)                                     noexcept(true);
+                static size_t    render(VALUEKIND kind, const char* bin, char* out)    noexcept(true);
+                static size_t    putInt(int64_t num, char* out)                        noexcept(true);
+                static size_t    putDate(int64_t days, char* out)                      noexcept(true);
+                static size_t    putTime(int64_t usecs, char* out)                     noexcept(true);
+                static bool      getInt(const char* text, size_t len, int64_t& num)    noexcept(true);
+                static bool      getDate(const char* text, size_t len, int64_t& days)  noexcept(true);
+                static bool      getTime(const char* text, size_t len, int64_t& usecs) noexcept(true);
+};
+
+} // end namespace dbfsutils
+
+#endif
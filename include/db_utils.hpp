@@ -25,14 +25,24 @@
 #include <exception> 
 #include <iostream> 
 #include <fstream> 
+#include <sstream> 
 #include <cstring>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <poll.h>
+#include <errno.h>
 
 extern "C"{
 #include <postgresql/libpq-fe.h>
@@ -40,17 +50,34 @@ extern "C"{
 
 #include <syslog.hpp>
 #include <Types.hpp>
+#include <table_store.hpp>
+#include <row_filter.hpp>
+#include <column_store.hpp>
 
 namespace dbfsutils{
 
 typedef  struct stat                               Stat;
 typedef  std::string                               TableName;
-typedef  size_t                                    RowNum;
-typedef  std::vector<char>                         TableData;
-typedef  std::tuple<RowNum, TableData, Stat>       TableAttr;
+typedef  std::shared_ptr<TableStore>               StorePtr;
+typedef  std::string                               TableVersion;
+typedef  std::tuple<std::string, StorePtr,
+                    unsigned int>                  Column;
+typedef  std::vector<Column>                       Columns;
+typedef  std::shared_ptr<const Columns>            ColumnsPtr;
+typedef  std::shared_ptr<const RowIndex>           RowIndexPtr;
+typedef  std::tuple<RowNum, StorePtr, Stat, 
+                    TableVersion, ColumnsPtr,
+                    RowIndexPtr, ValueIndexesPtr>  TableAttr;
 typedef  std::map<TableName, TableAttr>            TableList;
+typedef  std::vector<TableName>                    TableNames;
+typedef  std::map<std::string, std::string>        TableOptions;
+typedef  std::map<TableName, TableOptions>         TableConfig;
 
-enum ATTRIB { RNUM, DATA, SSTAT };
+enum ATTRIB      { RNUM, DATA, SSTAT, VERS, COLS, RIDX, VIDX };
+enum COLUMNATTR  { COLNAME, COLSTORE, COLTYPE };
+enum LOADMODE    { LOAD_SELECT, LOAD_COPY, LOAD_CURSOR };
+enum CHANGECHECK { CHECK_NONE, CHECK_STATS, CHECK_XMIN };
+enum STOREENGINE { ENGINE_FLAT, ENGINE_LZ4, ENGINE_MEMFD, ENGINE_COLUMNAR };
 
 class DbConnExc final {
       public:
@@ -64,6 +91,17 @@ class DbConnExc final {
          std::string errorMessage;
    };
 
+// Configuration file: a table per line, optionally followed by options in the form key=value.
+// Empty lines and lines beginning with '#' are skipped.
+
+void             readTableConfig(const std::string& cfile, TableConfig& config,
+                                 TableNames& names)                                      noexcept(false);
+
+// The columns and the index of the rows of a table kept by rows, as they are after the last change.
+
+ColumnsPtr       rowColumns(const RowStore& store)                                       noexcept(false);
+RowIndexPtr      rowOffsets(const RowStore& store)                                       noexcept(false);
+
 class DbConnection{
         public:
                 explicit         DbConnection(syslogwrp::Syslog *slog);
@@ -79,6 +117,22 @@ class DbConnection{
                                                                                          = 0;
                 virtual void     printDebug(const TableList& db)                         = 0;
                 virtual void     reset(void)                                             = 0;
+                virtual void     setLoaders(size_t num)                                  = 0;
+                virtual void     setLoadMode(LOADMODE mode)                              = 0;
+                virtual void     setFetchRows(size_t rows)                               = 0;
+                virtual void     setChangeCheck(CHANGECHECK check)                       = 0;
+                virtual void     setRowStore(bool enable)                                = 0;
+                virtual void     setSnapshot(const std::string& snapshot)                = 0;
+                virtual void     setLazy(bool enable)                                    = 0;
+                virtual void     setStoreEngine(STOREENGINE engine)                      = 0;
+                virtual void     setColumnFiles(bool enable)                             = 0;
+                virtual void     setRowIndex(bool enable)                                = 0;
+                virtual void     setColumnNames(bool enable)                             = 0;
+                virtual void     loadTables(TableList& db, const TableNames& names)      = 0;
+                virtual void     fetchTable(TableName tableName, TableAttr& tableAttr)   = 0;
+                virtual void     indexTable(TableName tableName, TableAttr& tableAttr)   = 0;
+                virtual void     listen(const std::string& channel)                      = 0;
+                virtual bool     waitNotifies(TableNames& names, int timeoutMs)          = 0;
     
         protected:
                 syslogwrp::Syslog            *syslog;
@@ -101,13 +155,89 @@ class PsqlConnection : public DbConnection {
                                                                                     noexcept(false)  override;
                 void     printDebug(const TableList& db)                            noexcept(true)   override;
                 void     reset(void);
+                void     setLoaders(size_t num)                                     noexcept(true)   override;
+                void     setLoadMode(LOADMODE mode)                                 noexcept(true)   override;
+                void     setFetchRows(size_t rows)                                  noexcept(true)   override;
+                void     setChangeCheck(CHANGECHECK check)                          noexcept(true)   override;
+                void     setRowStore(bool enable)                                   noexcept(true)   override;
+                void     setSnapshot(const std::string& snapshot)                   noexcept(true)   override;
+                void     setLazy(bool enable)                                       noexcept(true)   override;
+                void     setStoreEngine(STOREENGINE engine)                         noexcept(true)   override;
+                void     setColumnFiles(bool enable)                                noexcept(true)   override;
+                void     setRowIndex(bool enable)                                   noexcept(true)   override;
+                void     setColumnNames(bool enable)                                noexcept(true)   override;
+                void     loadTables(TableList& db, const TableNames& names)         noexcept(false)  override;
+                void     fetchTable(TableName tableName, TableAttr& tableAttr)      noexcept(false)  override;
+                void     indexTable(TableName tableName, TableAttr& tableAttr)      noexcept(false)  override;
+                void     listen(const std::string& channel)                         noexcept(false)  override;
+                bool     waitNotifies(TableNames& names, int timeoutMs)             noexcept(false)  override;
     
         protected:
+                typedef std::tuple<size_t, std::string, TableData, RowNum, 
+                                   ColumnData, RowIndex>                    LoadJob;
+                enum JOBATTR { JTABLE, JQUERY, JDATA, JROWS, JCOLS, JINDEX };
+
                 Stat                         statTempl;
                 std::string                  connectionString;
                 PGconn                       *conn;
+                size_t                       loaders;
+                LOADMODE                     loadMode;
+                size_t                       fetchRows;
+                CHANGECHECK                  changeCheck;
+                bool                         rowStore,
+                                             lazy,
+                                             columnFiles,
+                                             rowIndex,
+                                             keepNames;
+                STOREENGINE                  storeEngine;
+                std::string                  importSnapshot;
+                TableConfig                  tableConfig;
+                std::vector<PGconn*>         pool;
+                std::mutex                   mtxPool,
+                                             mtxConfig;
 
                 void     loadTable(TableName tableName, TableAttr& tableAttr)       noexcept(false)  override;
+                void     loadTables(TableList& db, const TableNames& names, 
+                                   bool checkVersion)                               noexcept(false);
+                void     loadTable(PGconn* pconn, TableName tableName, 
+                                   TableAttr& tableAttr)                            noexcept(false);
+                RowNum   queryRows(PGconn* pconn, const std::string& query, 
+                                   TableData& tdata, ColumnData* cdata,
+                                   RowIndex* index)                                 noexcept(false);
+                RowNum   selectRows(PGconn* pconn, const std::string& query, 
+                                   TableData& tdata, ColumnData* cdata,
+                                   RowIndex* index)                                 noexcept(false);
+                RowNum   copyRows(PGconn* pconn, const std::string& query, 
+                                   TableData& tdata, ColumnData* cdata,
+                                   RowIndex* index)                                 noexcept(false);
+                RowNum   cursorRows(PGconn* pconn, const std::string& query, 
+                                   TableData& tdata, ColumnData* cdata,
+                                   RowIndex* index)                                 noexcept(false);
+                RowNum   estimateRows(PGconn* pconn, 
+                                   const std::string& query)                        noexcept(false);
+                void     loadTableRows(PGconn* pconn, TableName tableName, 
+                                   TableAttr& tableAttr)                            noexcept(false);
+                size_t   appendRows(PGresult* result, TableData& tdata,
+                                   ColumnData* cdata, RowIndex* index)              noexcept(false);
+                void     columnNames(PGconn* pconn, const TableName& tableName,
+                                   ColumnNames& names, ColumnTypes& types)          noexcept(false);
+                void     stampTable(TableAttr& tableAttr, RowNum rows)              noexcept(true);
+                StorePtr makeStore(TableData&& tdata, RowNum rows,
+                                   const ColumnTypes& types=ColumnTypes())          noexcept(false);
+                ColumnsPtr makeColumns(const ColumnNames& names, const ColumnTypes& types,
+                                   ColumnData&& cdata, RowNum rows)                 noexcept(false);
+                void     loadParallel(TableList& db, const TableNames& names)       noexcept(false);
+                void     splitRanges(PGconn* pconn, const TableName& tableName,
+                                   std::vector<std::string>& queries)               noexcept(false);
+                void     sortBySize(const TableNames& names, TableNames& sorted)    noexcept(false);
+                TableVersion probeVersion(TableName tableName)                      noexcept(true);
+                void     execCmd(PGconn* pconn, const std::string& cmd)             noexcept(false);
+                void     connect(const std::string& connString)                     noexcept(false);
+                std::string  connectionParams(void)                                 noexcept(false);
+                TableOptions tableOptions(const TableName& tableName)               noexcept(false);
+                PGconn*  getPooled(void)                                            noexcept(false);
+                void     putPooled(PGconn* pconn)                                   noexcept(true);
+                void     closePool(void)                                            noexcept(true);
 }; 
 
 class DBIface{
@@ -27,13 +27,15 @@
 
 #include <config.h>
 
-#include <fuse.h>
+#include <fuse_lowlevel.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <sys/types.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include <exception>
 #include <stdexcept>
@@ -42,6 +44,7 @@
 #include <tuple>
 #include <string>
 #include <cstring>
+#include <cctype>
 #include <utility>
 #include <iostream>
 #include <limits>
@@ -49,24 +52,79 @@
 #include <algorithm>
 #include <atomic> 
 #include <mutex>
-#include <condition_variable>
+#include <thread>
+#include <set>
+#include <chrono>
 
 #include <db_utils.hpp>
+#include <replication.hpp>
+#include <snapshot.hpp>
+#include <name_index.hpp>
+#include <row_filter.hpp>
+#include <table_format.hpp>
 #include <syslog.hpp>
 
 namespace dbfs{
 
-    typedef struct fuse_operations                    Fuse;
+    typedef struct fuse_lowlevel_ops                  Fuse;
     typedef struct fuse_file_info                     FileInfo;
+    typedef struct fuse_conn_info                     ConnInfo;
+    typedef struct fuse_entry_param                   EntryParam;
+    typedef struct fuse_args                          FuseArgs;
+    typedef fuse_req_t                                Request;
+    typedef fuse_ino_t                                Inode;
+
+    // A table is a file in the root directory or, with table directories, a directory
+    // holding the full rows, a file for each column and the directories of the virtual 
+    // files: ranges of rows, or the rows selected by a filter or by the value of an indexed
+    // column, named when they are looked up. Next to it, in the root directory, the table
+    // converted to every output format.
+
+    enum NODEKIND    { NODE_TABLE, NODE_DIR, NODE_ALL, NODE_COLUMN, NODE_ROWS, NODE_HEAD,
+                       NODE_FILTER, NODE_GREP, NODE_INDEX, NODE_FORMAT };
 
     typedef std::string                               Filename;
     typedef std::string                               Path;
     typedef dbfsutils::TableList                      Filesystem;
+    typedef std::shared_ptr<const Filesystem>         FilesystemPtr;
+    typedef std::tuple<dbfsutils::NameIndex,
+                       std::vector<Filename>>         Inodes;
+    typedef std::shared_ptr<const Inodes>             InodesPtr;
+    typedef std::tuple<Path, NODEKIND, size_t>        Node;
+    typedef std::vector<Node>                         Nodes;
+    typedef std::tuple<const dbfsutils::TableAttr*,
+                       NODEKIND, size_t, Inode>       Entry;
+    typedef std::vector<Entry>                        Entries;
+    typedef std::tuple<Path, unsigned long>           Virtual;
+    typedef std::tuple<std::weak_ptr<const dbfsutils::RowIndex>,
+                       dbfsutils::StorePtr,
+                       unsigned long>                 Result;
+    typedef std::tuple<Inode, size_t>                 RenderKey;
+    typedef std::tuple<std::weak_ptr<const dbfsutils::TableStore>,
+                       dbfsutils::StorePtr>           Rendered;
+    typedef std::map<const dbfsutils::TableStore*,
+                     size_t>                          RenderedBytes;
+    typedef std::tuple<std::weak_ptr<const dbfsutils::TableStore>,
+                       uint64_t>                      Reload;
+    typedef std::map<dbfsutils::TableName, Reload>    Reloads;
+    typedef std::tuple<Filesystem, Entries,
+                       InodesPtr>                     Catalog;
+    typedef std::shared_ptr<const Catalog>            CatalogPtr;
     typedef struct sockaddr                           Sockaddr; 
     typedef struct sockaddr_un                        SockaddrUn;
     typedef siginfo_t                                 Siginfo;
     typedef struct sigaction                          Sigaction;
 
+    enum INODEATTR   { BYNAME, BYINODE };
+    enum NODEATTR    { NPATH, NKIND, NCOLUMN };
+    enum ENTRYATTR   { ENTRY_ATTR, ENTRY_KIND, ENTRY_COLUMN, ENTRY_TABLE };
+    enum VIRTUALATTR { VPATH, VLOOKUPS };
+    enum RESULTATTR  { RES_INDEX, RES_STORE, RES_TICK };
+    enum RENDERKEYATTR { RKEY_TABLE, RKEY_FORMAT };
+    enum RENDERATTR  { REN_SOURCE, REN_STORE };
+    enum RELOADATTR  { RLD_SOURCE, RLD_LSN };
+    enum CATALOGATTR { CAT_TABLES, CAT_ENTRIES, CAT_INODES };
+
     void genericExcPtrHdlr(syslogwrp::Syslog* slog, std::exception_ptr exptr)            noexcept(false);
 
     class Dbfs{
@@ -86,28 +144,69 @@ namespace dbfs{
                                                       std::string         address,
                                                       std::string         port,   
                                                       std::string         pwd)            noexcept(false);
+             int           mountFileSystem(           int                 argc,
+                                                      char                *argv[])        noexcept(false);
              bool          refreshDb(                 void)                               noexcept(false);
+             bool          reloadTables(              const dbfsutils::TableNames& 
+                                                                          names,
+                                                      const std::string&  snapshot="")    noexcept(false);
+             void          setLoaders(                size_t              num)            noexcept(true);
+             void          setLoadMode(               dbfsutils::LOADMODE mode)           noexcept(true);
+             void          setFetchRows(              size_t              rows)           noexcept(true);
+             void          setChangeCheck(            dbfsutils::CHANGECHECK
+                                                                          check)          noexcept(true);
+             void          requestRefresh(            const dbfsutils::TableNames& 
+                                                                          names)          noexcept(true);
+             void          setNotifyChannel(          const std::string&  channel)        noexcept(true);
+             void          setReplication(            bool                enable)         noexcept(true);
+             void          setLazy(                   bool                enable)         noexcept(true);
+             void          setMemBudget(              size_t              bytes)          noexcept(true);
+             void          setStoreEngine(            dbfsutils::STOREENGINE
+                                                                          engine)         noexcept(true);
+             void          setSnapshotFile(           const std::string&  path)           noexcept(true);
+             void          setKernelCache(            bool                enable)         noexcept(true);
+             void          setTableDirs(              bool                enable)         noexcept(true);
+             void          setFormats(                const dbfsutils::OutFormats&
+                                                                          formats,
+                                                      bool                header)         noexcept(true);
            
              static void   refreshHdlr(               int                 sig, 
                                                       Siginfo             *sinfo,   
                                                       void                *ctx)           noexcept(true);
-             static bool   extractIds(                const char*         buff,
-                                                      std::string&        path, 
-                                                      std::string&        file)           noexcept(true);
-             static int    readdirCb(                 const char          *path, 
-                                                      void                *buf, 
-                                                      fuse_fill_dir_t     filler, 
-                                                      off_t               offset, 
+             static void   lookupCb(                  Request             req,
+                                                      Inode               parent,
+                                                      const char          *name)          noexcept(true);
+             static void   forgetCb(                  Request             req,
+                                                      Inode               ino,
+                                                      unsigned long       nlookup)        noexcept(true);
+             static void   getattrCb(                 Request             req,
+                                                      Inode               ino,
+                                                      FileInfo            *fi)            noexcept(true);
+             static void   opendirCb(                 Request             req,
+                                                      Inode               ino,
                                                       FileInfo            *fi)            noexcept(true);
-             static int    openCb(                    const char          *path, 
+             static void   readdirCb(                 Request             req,
+                                                      Inode               ino,
+                                                      size_t              size,
+                                                      off_t               offset,
+                                                      FileInfo            *fi)            noexcept(true);
+             static void   releasedirCb(              Request             req,
+                                                      Inode               ino,
                                                       FileInfo            *fi)            noexcept(true);
-             static int    readCb(                    const char          *path, 
-                                                      char                *buf,
+             static void   openCb(                    Request             req,
+                                                      Inode               ino,
+                                                      FileInfo            *fi)            noexcept(true);
+             static void   readCb(                    Request             req,
+                                                      Inode               ino,
                                                       size_t              size, 
                                                       off_t               offset,
                                                       FileInfo            *fi)            noexcept(true); 
-             static int    getattrCb(                 const char          *path,
-                                                      dbfsutils::Stat     *stbuf)         noexcept(true);
+             static void   releaseCb(                 Request             req,
+                                                      Inode               ino,
+                                                      FileInfo            *fi)            noexcept(true);
+             static void   initCb(                    void                *data,
+                                                      ConnInfo            *conn)          noexcept(true);
+             static void   destroyCb(                 void                *data)          noexcept(true);
                
              static const  dbfsutils::Stat            statTempl;
          private:
@@ -118,6 +217,93 @@ namespace dbfs{
                            Dbfs(                      Dbfs const&);
                     void   operator=(                 Dbfs const&);
                     void   openSrvSocket(             void)                               noexcept(false);
+                    void   listenLoop(                void)                               noexcept(true);
+                    void   replicaLoop(               void)                               noexcept(true);
+                    void   scheduleLoop(              void)                               noexcept(true);
+                    void   readTtls(                  std::map<dbfsutils::TableName, time_t>&
+                                                                          ttls)           noexcept(true);
+                    void   saveSnapshot(              void)                               noexcept(true);
+                    void   applyChanges(              dbfsutils::Changes& changes,
+                                                      std::set<dbfsutils::TableName>&
+                                                                          reload)         noexcept(false);
+                  static   int    loadLazy(           const std::string&  fileName,
+                                                      bool&               loaded)         noexcept(true);
+                  static   void   enforceBudget(      Filesystem&         next,
+                                                      const std::string&  keep)           noexcept(true);
+                  static   FilesystemPtr  tables(     void)                               noexcept(true);
+                  static   CatalogPtr     catalog(    void)                               noexcept(true);
+                  static   InodesPtr      assignInodes(
+                                                      const InodesPtr&    prev,
+                                                      const Filesystem&   next,
+                                                      const std::set<dbfsutils::TableName>&
+                                                                          tables)         noexcept(false);
+                  static   const Filename* inodeName( const CatalogPtr&   cat,
+                                                      Inode               ino)            noexcept(true);
+                  static   const Entry*   inodeEntry( const CatalogPtr&   cat,
+                                                      Inode               ino)            noexcept(true);
+                  static   void   tableNodes(         const dbfsutils::TableName&
+                                                                          table,
+                                                      const dbfsutils::TableAttr&
+                                                                          attr,
+                                                      Nodes&              nodes)          noexcept(false);
+                  static   dbfsutils::StorePtr entryStore(
+                                                      const Entry&        entry)          noexcept(true);
+                  static   dbfsutils::Stat     entryStat(
+                                                      const Entry&        entry,
+                                                      Inode               ino)            noexcept(true);
+                  static   size_t tableMemory(        const dbfsutils::TableAttr&
+                                                                          attr,
+                                                      const RenderedBytes& rendered)      noexcept(true);
+                  static   bool   isDir(              NODEKIND            kind)           noexcept(true);
+                  static   bool   rowRange(           NODEKIND            kind,
+                                                      const std::string&  spec,
+                                                      dbfsutils::RowNum&  first,
+                                                      dbfsutils::RowNum&  last)           noexcept(true);
+                  static   Inode  virtualInode(       const Path&         path)           noexcept(false);
+                  static   bool   virtualPath(        Inode               ino,
+                                                      Path&               path)           noexcept(false);
+                  static   void   forgetVirtual(      Inode               ino,
+                                                      unsigned long       nlookup)        noexcept(true);
+                  static   dbfsutils::StorePtr formatStore(
+                                                      const Entry&        entry,
+                                                      bool                render=true)    noexcept(false);
+                  static   void   dropRendered(       const Catalog&      cat,
+                                                      const std::set<dbfsutils::TableName>&
+                                                                          changed)        noexcept(true);
+                  static   bool   findResult(         const Path&         path,
+                                                      const dbfsutils::RowIndexPtr&
+                                                                          index,
+                                                      dbfsutils::StorePtr& store)         noexcept(false);
+                  static   void   keepResult(         const Path&         path,
+                                                      const dbfsutils::RowIndexPtr&
+                                                                          index,
+                                                      const dbfsutils::StorePtr&
+                                                                          store)          noexcept(false);
+                  static   int    filterStore(        const Path&         path,
+                                                      const Entry&        dir,
+                                                      const std::string&  spec,
+                                                      dbfsutils::StorePtr& store)         noexcept(false);
+                  static   int    virtualStore(       const CatalogPtr&   cat,
+                                                      const Path&         path,
+                                                      dbfsutils::StorePtr& store,
+                                                      const Entry*&       table)          noexcept(false);
+                  static   int    openVirtual(        const Path&         path,
+                                                      CatalogPtr&         cat,
+                                                      dbfsutils::StorePtr& store,
+                                                      const Entry*&       table,
+                                                      bool&               loaded)         noexcept(true);
+                  static   dbfsutils::Stat     virtualStat(
+                                                      const Entry&        table,
+                                                      const dbfsutils::StorePtr& 
+                                                                          store,
+                                                      Inode               ino)            noexcept(true);
+                  static   void   publish(            Filesystem&&        next,
+                                                      const std::set<dbfsutils::TableName>&
+                                                                          touched
+                                                          = std::set<dbfsutils::TableName>()) noexcept(false);
+                  static   void   flushInvalidations( void)                               noexcept(true);
+                  static   dbfsutils::StorePtr currentStore(
+                                                      Inode               ino)            noexcept(false);
                   static   syslogwrp::Syslog          *syslog;
  
                            std::string                mountPoint,
@@ -127,16 +313,59 @@ namespace dbfs{
                                                       userName, 
                                                       dbAddress,
                                                       dbPort,   
-                                                      dbPwd;
+                                                      dbPwd,
+                                                      notifyChannel,
+                                                      snapshotFile;
                            std::unique_ptr<dbfsutils::DbConnection>
                                                       dbconn;
+                           bool                       replication,
+                                                      lazy,
+                                                      restored,
+                                                      warmStart,
+                                                      refreshWarned;
+                           std::unique_ptr<dbfsutils::PsqlReplication>
+                                                      replica;
                   static   Dbfs*                      singleDbfs;
-                  static   Filesystem                 fsdb;
-                  static   std::atomic<bool>          refreshing; 
-                  static   std::atomic<unsigned long> running; 
+                  static   CatalogPtr                 fsdb;
+                  static   bool                       spliceReads;
+                  static   bool                       kernelCache;
+                  static   bool                       tableDirs;
+                  static   bool                       escapedFields;
+                  static   dbfsutils::OutFormats      formats;
+                  static   bool                       formatHeader;
+                  static   std::mutex                 mtxRendered;
+                  static   std::map<RenderKey, Rendered>
+                                                      rendered;
+                  static   struct fuse_chan           *channel;
+                  static   std::mutex                 mtxStale;
+                  static   std::set<Inode>            staleInodes;
+                  static   std::mutex                 mtxVirtual;
+                  static   std::map<Inode, Virtual>   virtuals;
+                  static   std::map<Path, Inode>      virtualInodes;
+                  static   Inode                      nextVirtual;
+                  static   std::mutex                 mtxResults;
+                  static   std::map<Path, Result>     results;
+                  static   unsigned long              resultTick;
                   static   Sigaction                  saction;
-                  static   std::mutex                 mtxRefresh;
-                  static   std::condition_variable    cndRefresh;
+                  static   std::mutex                 mtxLoad;
+                  static   std::thread                listener;
+                  static   std::thread                replicator;
+                  static   std::thread                scheduler;
+                  static   std::mutex                 mtxQueue;
+                  static   std::set<std::string>      queued;
+                  static   bool                       fullQueued;
+                  static   int                        wakePipe[2];
+                  static   std::atomic<bool>          sigRefresh;
+                  static   std::mutex                 mtxLatches;
+                  static   std::map<std::string, std::shared_ptr<std::mutex>>
+                                                      latches;
+                  static   size_t                     memBudget;
+                  static   std::atomic<unsigned long> accessTick;
+                  static   unsigned long              evictions,
+                                                      reloads;
+                  static   std::set<std::string>      evicted;
+                  static   std::atomic<bool>          stopping; 
+                  static   std::atomic<bool>          snapshotDirty;
     };
 
 } // namespace dbfs
@@ -0,0 +1,60 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#ifndef  DB__NAME_INDEX
+#define  DB__NAME_INDEX
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <cstring>
+
+#include <sys/types.h>
+#include <stdint.h>
+
+namespace dbfsutils{
+
+// Names of the tables mapped to numbers, in an open addressing hash table with linear probing.
+// The names are copied in a single arena and looked up by pointer and length: a lookup
+// doesn't allocate, whatever the caller holds (a C string from the kernel, a std::string).
+
+class NameIndex{
+        public:
+                enum INDEXCONST  { INITIAL_SLOTS=16 };
+
+                                 NameIndex(void);
+                bool             insert(const char* name, size_t len, size_t value)   noexcept(false);
+                bool             find(const char* name, size_t len, size_t& value)    const noexcept(true);
+                bool             find(const std::string& name, size_t& value)         const noexcept(true);
+                size_t           size(void)                                           const noexcept(true);
+                static uint64_t  hash(const char* name, size_t len)                   noexcept(true);
+
+        private:
+                typedef std::tuple<uint64_t, size_t, size_t, size_t>    Slot;
+                enum SLOTATTR    { SHASH, SOFFSET, SLEN, SVALUE };
+
+                std::vector<Slot>                    slots;
+                std::vector<char>                    arena;
+                size_t                               used;
+
+                static bool      empty(const Slot& slot)                              noexcept(true);
+                void             grow(void)                                           noexcept(false);
+};
+
+} // end namespace dbfsutils
+
+#endif
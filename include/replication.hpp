@@ -0,0 +1,99 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#ifndef  PQ_REPLICATION
+#define  PQ_REPLICATION
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+extern "C"{
+#include <postgresql/libpq-fe.h>
+}
+
+#include <syslog.hpp>
+#include <table_store.hpp>
+#include <db_utils.hpp>
+
+namespace dbfsutils{
+
+enum CHANGEOP    { CHANGE_INSERT, CHANGE_UPDATE, CHANGE_DELETE, CHANGE_TRUNCATE, CHANGE_UNKNOWN };
+enum CHANGEATTR  { CTABLE, COP, COLD, CNEW };
+
+typedef  std::tuple<std::string, CHANGEOP,
+                    Fields, Fields>                Change;
+typedef  std::vector<Change>                       Changes;
+
+// Logical replication stream of a temporary slot decoded with test_decoding.
+// The slot exports the snapshot used for the initial load of the tables,
+// then receive() returns the changes of every committed transaction.
+
+class PsqlReplication{
+        public:
+                explicit         PsqlReplication(syslogwrp::Syslog *slog);
+                                 ~PsqlReplication();
+                void             connect(std::string dbname, std::string user,
+                                         std::string hostAddr, std::string port,
+                                         std::string pwd)                                 noexcept(false);
+                std::string      createSlot(void)                                         noexcept(false);
+                void             start(void)                                              noexcept(false);
+                bool             streaming(void)                                    const noexcept(true);
+                bool             receive(Changes& changes, int timeoutMs)                 noexcept(false);
+                uint64_t         committed(void)                                    const noexcept(true);
+                void             confirm(uint64_t lsn)                                    noexcept(false);
+                void             close(void)                                              noexcept(true);
+
+                static bool      parseChange(const char* data, size_t len,
+                                             Changes& changes)                            noexcept(false);
+
+        private:
+                syslogwrp::Syslog            *syslog;
+                std::string                  connectionString,
+                                             slotName,
+                                             startPoint;
+                PGconn                       *conn;
+                bool                         started,
+                                             inTransaction;
+                uint64_t                     lastReceived,
+                                             lastCommit,
+                                             lastConfirmed;
+                time_t                       lastStatus;
+                Changes                      pending;
+
+                void             sendStatus(bool reply)                                   noexcept(false);
+                static uint64_t  getInt64(const char* buf)                                noexcept(true);
+                static void      putInt64(char* buf, uint64_t val)                        noexcept(true);
+                static uint64_t  parseLsn(const std::string& lsn)                         noexcept(true);
+                static bool      parseIdent(const char*& pos, const char* end,
+                                            std::string& ident)                           noexcept(false);
+                static bool      parseTuple(const char*& pos, const char* end,
+                                            Fields& tuple)                                noexcept(false);
+};
+
+} // end namespace dbfsutils
+
+#endif
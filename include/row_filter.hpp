@@ -0,0 +1,112 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#ifndef  ROW__FILTER
+#define  ROW__FILTER
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <cstring>
+#include <limits>
+
+#include <sys/types.h>
+
+#include <table_store.hpp>
+#include <name_index.hpp>
+
+namespace dbfsutils{
+
+// The value of a field in a row, as it's rendered by the loaders: every field is followed by ';'.
+// A value searched in a table loaded with COPY is escaped like the server escapes it, then
+// compared with the fields as they are.
+
+bool             fieldValue(const char* row, const char* end, size_t field, bool escaped,
+                            const char*& value, size_t& len)                              noexcept(true);
+std::string      copyEscape(const std::string& value)                                    noexcept(false);
+
+// Rows of a cached table selected by the text they contain. The table is searched 
+// for the pattern with memmem(), and every match is mapped to its row through the
+// row index: the rows not containing the pattern are skipped without being parsed.
+// A field filter then compares the field of the row at the column given, a text
+// filter takes the row as it is. A large table is scanned in parts, one thread 
+// each; the rows selected are copied to the result in the order of the table.
+
+class RowFilter{
+        public:
+                enum FILTERMODE  { FILTER_FIELD, FILTER_TEXT };
+                enum FILTERCONST { PART_BYTES=4194304, PART_MAX=8 };
+
+                                 RowFilter(FILTERMODE mode, const std::string& pattern,
+                                           size_t column=0, bool escaped=false);
+                RowNum           select(const char* data, const RowIndex& index,
+                                        TableData& result)                             const noexcept(false);
+
+        private:
+                typedef std::vector<RowNum>          Rows;
+
+                FILTERMODE                           filterMode;
+                std::string                          text;
+                size_t                               field;
+                bool                                 escapes;
+
+                void             scan(const char* data, const RowIndex& index,
+                                      RowNum first, RowNum last, Rows& rows)          const noexcept(false);
+                bool             matchField(const char* row, const char* end)         const noexcept(true);
+                static bool      escapedAt(const char* row, const char* pos)                noexcept(true);
+};
+
+// The rows of a table by the value of a column, in an open addressing hash table with linear
+// probing. A slot holds the hash of a value and the first and the last row with it; the other 
+// rows follow the first in a chain, in the order of the table. The values aren't copied: they
+// are compared with the fields of the rows, through the row index of the table.
+
+class ValueIndex{
+        public:
+                                 ValueIndex(const std::string& columnName, size_t column, 
+                                            bool escaped=false);
+                void             build(const char* data, const RowIndex& index)               noexcept(false);
+                RowNum           find(const TableStore& store, const RowIndex& index,
+                                      const std::string& value, TableData& result)      const noexcept(false);
+                const std::string&  name(void)                                          const noexcept(true);
+                size_t           values(void)                                           const noexcept(true);
+                size_t           memory(void)                                           const noexcept(true);
+
+        private:
+                typedef std::tuple<uint64_t, RowNum, RowNum>            Slot;
+                enum SLOTATTR    { SHASH, SFIRST, SLAST };
+
+                static const RowNum                  NO_ROW  {std::numeric_limits<RowNum>::max()};
+
+                std::string                          colName;
+                size_t                               field;
+                bool                                 escapes;
+                std::vector<Slot>                    slots;
+                std::vector<RowNum>                  next;
+                size_t                               used;
+};
+
+typedef  std::vector<ValueIndex>                   ValueIndexes;
+typedef  std::shared_ptr<const ValueIndexes>       ValueIndexesPtr;
+
+} // end namespace dbfsutils
+
+#endif
@@ -0,0 +1,83 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#ifndef  DB__SNAPSHOT
+#define  DB__SNAPSHOT
+
+#include <string>
+#include <memory>
+#include <stdexcept>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <syslog.hpp>
+#include <table_store.hpp>
+#include <db_utils.hpp>
+
+namespace dbfsutils{
+
+// On-disk copy of the tables in memory, restored with a mapping of the file at the next 
+// start. The layout is host specific (native integers and struct stat):
+//
+//   header: magic, format, table count, file length
+//   for every table: entry, name, version, data - each one aligned to 8 bytes
+
+class Snapshot{
+        public:
+                static void      save(const std::string& path, const TableList& db,
+                                      syslogwrp::Syslog *slog)                          noexcept(false);
+                static bool      restore(const std::string& path, TableList& db,
+                                         syslogwrp::Syslog *slog)                       noexcept(false);
+
+        private:
+                enum SNAPCONST   { FORMAT=1, ALIGN=8, WRITE_BUFF=1048576 };
+
+                struct Header{
+                        char      magic[8];
+                        uint32_t  format;
+                        uint32_t  tables;
+                        uint64_t  length;
+                };
+
+                struct Entry{
+                        uint64_t  nameLen,
+                                  versionLen,
+                                  rows,
+                                  offset,
+                                  size;
+                        int64_t   loaded;
+                        Stat      stat;
+                };
+
+                static const char   MAGIC[8];
+
+                static size_t    aligned(size_t len)                                    noexcept(true);
+                static bool      fits(size_t pos, uint64_t len, size_t length)          noexcept(true);
+                static void      writeAll(int fd, const char* buf, size_t len,
+                                          uint64_t& written)                            noexcept(false);
+                static void      padAll(int fd, uint64_t& written)                      noexcept(false);
+};
+
+} // end namespace dbfsutils
+
+#endif
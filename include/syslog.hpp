@@ -20,10 +20,28 @@
 
 #include <initializer_list>
 #include <string>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <cstring>
+#include <cstdint>
 
 #include <syslog.h>
+#include <unistd.h>
+
+// Logs through slog only if the priority is in its mask: otherwise the cost 
+// is a single branch and the arguments of the message aren't even evaluated.
+#define DBFS_LOG(slog, msgPriority, ...)                                              \
+        do{                                                                           \
+            if((slog)->enabled(msgPriority)) (slog)->log(msgPriority, __VA_ARGS__);   \
+        }while(0)
 
 namespace syslogwrp{
+
+    // After startAsync() the messages are queued in a lock-free ring and written
+    // to syslog(3) by a background thread: a logging thread never blocks. When 
+    // the ring is full the message is dropped and counted.
+
     class Syslog{
         public:
             Syslog(std::string ident, int opts, int facility);
@@ -31,14 +49,40 @@ namespace syslogwrp{
             int getPriority(void)                                  const noexcept(true);
             int getOldPriority(void)                               const noexcept(true);
             void setPriority(int newPriority)                            noexcept(true);
+            bool enabled(int msgPriority)                          const noexcept(true);
             void log(int msgPriority, 
                      std::initializer_list<std::string> arguments) const noexcept(true);
             void log(int msgPriority, const char* msg)             const noexcept(true); 
+            void startAsync(void)                                        noexcept(false);
+            void stopAsync(void)                                         noexcept(true);
         private:
-            int priority;
-            int previousPriority;
+            enum RINGCONST { RING_SLOTS=4096, MSG_LEN=1000, IDLE_MS=5 };
+
+            struct Slot{
+                   std::atomic<size_t>  sequence;
+                   int                  priority;
+                   size_t               length;
+                   char                 text[MSG_LEN];
+            };
+
+            int                                  priority;
+            int                                  previousPriority;
+            std::unique_ptr<Slot[]>              ring;
+            mutable std::atomic<size_t>          enqueuePos;
+            size_t                               dequeuePos;
+            std::atomic<bool>                    running;
+            mutable std::atomic<unsigned long>   dropped;
+            std::thread                          writer;
+
+            void emit(int msgPriority, const char* msg, size_t len)      const noexcept(true);
+            void writeLoop(void)                                         noexcept(true);
+            bool drain(void)                                             noexcept(true);
 };
 
+    inline bool Syslog::enabled(int msgPriority) const noexcept(true){
+            return (priority & LOG_MASK(msgPriority)) != 0;
+    }
+
 class SyslogExc final {
       public:
          explicit    SyslogExc(int errNum);
@@ -0,0 +1,80 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#ifndef  TABLE__FORMAT
+#define  TABLE__FORMAT
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <sstream>
+#include <cstring>
+
+#include <sys/types.h>
+
+#include <table_store.hpp>
+#include <arrow_ipc.hpp>
+
+namespace dbfsutils{
+
+enum OUTFORMAT   { FORMAT_CSV, FORMAT_TSV, FORMAT_JSONL, FORMAT_ARROW };
+
+typedef  std::vector<OUTFORMAT>                    OutFormats;
+
+// A table converted from the format of the loaders, every field followed by ';', to CSV 
+// (RFC 4180), TSV (with the escapes of PostgreSQL's text format), JSON Lines, an object 
+// per row keyed by the names of the columns, or an Arrow IPC file typed by the types of
+// the columns. A row is read as a field for every column: only values containing ';' can't
+// be told apart, unless the table was loaded with COPY, whose escapes are decoded. CSV and
+// TSV start with the names of the columns, if asked.
+
+class TableFormat{
+        public:
+                                 TableFormat(OUTFORMAT format, const ColumnNames& columnNames,
+                                             bool escaped=false, bool header=false,
+                                             const ColumnTypes& columnTypes=ColumnTypes());
+                RowNum           render(const char* data, size_t len, TableData& out)  const noexcept(false);
+
+                static bool      parse(const std::string& list, OutFormats& formats,
+                                       bool& header)                                  noexcept(false);
+                static const char*  extension(OUTFORMAT format)                       noexcept(true);
+
+        private:
+                typedef std::tuple<const char*, size_t>                 Value;
+                enum VALUEATTR   { VTEXT, VLEN };
+
+                OUTFORMAT                            outFormat;
+                ColumnNames                          names;
+                ColumnTypes                          types;
+                bool                                 escapes,
+                                                     withHeader;
+
+                bool             nextRow(const char*& pos, const char* end,
+                                         std::vector<Value>& fields)                    const noexcept(true);
+                RowNum           renderArrow(const char* data, size_t len, TableData& out) const noexcept(false);
+                void             putValue(const char* text, size_t len, TableData& out) const noexcept(false);
+                void             putRow(const std::vector<Value>& fields, TableData& out)
+                                                                                        const noexcept(false);
+                static void      putCsv(const char* text, size_t len, TableData& out)        noexcept(false);
+                static void      putTsv(const char* text, size_t len, TableData& out)        noexcept(false);
+                static void      putJson(const char* text, size_t len, TableData& out)       noexcept(false);
+                static void      unescape(const char* text, size_t len, std::string& value)  noexcept(false);
+};
+
+} // end namespace dbfsutils
+
+#endif
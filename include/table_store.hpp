@@ -0,0 +1,282 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#ifndef  TABLE__STORE
+#define  TABLE__STORE
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <limits>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+
+#ifdef SYS_memfd_create
+#include <linux/memfd.h>
+#endif
+
+#include <config.h>
+
+#ifdef HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+
+namespace dbfsutils{
+
+typedef  size_t                                    RowNum;
+typedef  std::vector<char>                         TableData;
+typedef  std::vector<TableData>                    ColumnData;
+typedef  std::string                               RowKey;
+typedef  std::vector<std::string>                  ColumnNames;
+typedef  std::vector<unsigned int>                 ColumnTypes;
+
+enum FIELDSTATE  { FIELD_VALUE, FIELD_NULL, FIELD_UNCHANGED };
+enum FIELDATTR   { FNAME, FVALUE, FSTATE };
+
+typedef  std::tuple<std::string, std::string,
+                    FIELDSTATE>                    Field;
+typedef  std::vector<Field>                        Fields;
+
+// The content of a cached table, as it's seen through the file system:
+// a sequence of bytes that can be read from any offset.
+// A store whose bytes are contiguous in memory returns them in contiguous(), 
+// so a reader can send them without copying; if they are also the content of 
+// a file, descriptor() returns it, with the position of the first byte.
+
+class TableStore{
+        public:
+                                 TableStore(void);
+                virtual          ~TableStore();
+                virtual size_t   size(void)                                      const noexcept(true)  = 0;
+                virtual RowNum   rows(void)                                      const noexcept(true)  = 0;
+                virtual size_t   read(char* buf, size_t len, size_t offset)      const noexcept(false) = 0;
+                virtual size_t   memory(void)                                    const noexcept(true)  = 0;
+                virtual const char*  contiguous(void)                            const noexcept(true);
+                virtual int      descriptor(size_t& position)                    const noexcept(true);
+
+                void             touch(unsigned long tick)                       const noexcept(true);
+                unsigned long    accessed(void)                                  const noexcept(true);
+
+        private:
+                mutable std::atomic<unsigned long>   lastAccess;
+};
+
+// The whole table rendered in a single buffer, as produced by the loaders.
+
+class FlatStore : public TableStore {
+        public:
+                explicit         FlatStore(TableData&& tdata, RowNum rnum);
+                size_t           size(void)                                      const noexcept(true)  override;
+                RowNum           rows(void)                                      const noexcept(true)  override;
+                size_t           read(char* buf, size_t len, size_t offset)      const noexcept(false) override;
+                size_t           memory(void)                                    const noexcept(true)  override;
+                const char*      contiguous(void)                                const noexcept(true)  override;
+
+        private:
+                TableData        data;
+                RowNum           rowNum;
+};
+
+// A part of another store, read in place: a range of the rows of a table.
+
+class RangeStore : public TableStore {
+        public:
+                                 RangeStore(std::shared_ptr<TableStore> base,
+                                            size_t offset, size_t length, RowNum rnum);
+                size_t           size(void)                                      const noexcept(true)  override;
+                RowNum           rows(void)                                      const noexcept(true)  override;
+                size_t           read(char* buf, size_t len, size_t offset)      const noexcept(false) override;
+                size_t           memory(void)                                    const noexcept(true)  override;
+                const char*      contiguous(void)                                const noexcept(true)  override;
+                int              descriptor(size_t& position)                    const noexcept(true)  override;
+
+        private:
+                std::shared_ptr<TableStore>          store;
+                size_t                               start,
+                                                     total;
+                RowNum                               rowNum;
+};
+
+// The end offset of every row of a table, as it's rendered by its store: a range
+// of rows is found without reading the rows before it, and row() finds the row 
+// containing an offset with a binary search. The offsets take 32 bits each, 64 
+// once the table exceeds 4 GiB.
+
+class RowIndex{
+        public:
+                void             push(size_t end)                                      noexcept(false);
+                void             append(const RowIndex& other, size_t shift)           noexcept(false);
+                RowNum           rows(void)                                      const noexcept(true);
+                size_t           start(RowNum row)                               const noexcept(true);
+                RowNum           row(size_t offset)                              const noexcept(true);
+                size_t           memory(void)                                    const noexcept(true);
+
+        private:
+                std::vector<uint32_t>                narrow;
+                std::vector<uint64_t>                wide;
+};
+
+// A read only mapping of a whole file, released when the last table using it is dropped.
+// The descriptor of the file, if given, is kept open and closed with the mapping.
+
+class MappedFile{
+        public:
+                                 MappedFile(void* address, size_t length, int fd=-1);
+                                 ~MappedFile();
+                const char*      data(void)                                      const noexcept(true);
+                size_t           size(void)                                      const noexcept(true);
+                int              descriptor(void)                                const noexcept(true);
+
+                #ifdef SYS_memfd_create
+                static std::shared_ptr<const MappedFile>  
+                                 fromData(const TableData& tdata)                      noexcept(false);
+                #endif
+
+        private:
+                void             *addr;
+                size_t           len;
+                int              fileDesc;
+
+                                 MappedFile(MappedFile const&);
+                void             operator=(MappedFile const&);
+};
+
+// The table rendered like in FlatStore, read from a file mapped in memory: a snapshot
+// file, whose pages belong to the page cache and aren't counted in memory(), or a 
+// memory file (memfd), whose pages are resident.
+
+class MappedStore : public TableStore {
+        public:
+                                 MappedStore(std::shared_ptr<const MappedFile> mapped,
+                                             size_t offset, size_t length, RowNum rnum,
+                                             bool resident=false);
+                size_t           size(void)                                      const noexcept(true)  override;
+                RowNum           rows(void)                                      const noexcept(true)  override;
+                size_t           read(char* buf, size_t len, size_t offset)      const noexcept(false) override;
+                size_t           memory(void)                                    const noexcept(true)  override;
+                const char*      contiguous(void)                                const noexcept(true)  override;
+                int              descriptor(size_t& position)                    const noexcept(true)  override;
+
+        private:
+                std::shared_ptr<const MappedFile>    file;
+                const char                           *data;
+                size_t                               total;
+                RowNum                               rowNum;
+                bool                                 inMemory;
+};
+
+#ifdef HAVE_LIBLZ4
+
+// The table rendered like in FlatStore, split in fixed-size blocks compressed 
+// one by one with LZ4. A read decompresses only the blocks it overlaps; the 
+// last blocks decompressed are kept in a small cache, for sequential reads.
+
+class BlockStore : public TableStore {
+        public:
+                enum BLOCKCONST  { BLOCK_SIZE=65536, BLOCK_CACHE=4 };
+
+                                 BlockStore(TableData&& tdata, RowNum rnum, 
+                                            size_t blockLen=BLOCK_SIZE);
+                size_t           size(void)                                      const noexcept(true)  override;
+                RowNum           rows(void)                                      const noexcept(true)  override;
+                size_t           read(char* buf, size_t len, size_t offset)      const noexcept(false) override;
+                size_t           memory(void)                                    const noexcept(true)  override;
+
+        private:
+                typedef std::tuple<size_t, unsigned long, TableData>    CachedBlock;
+                enum CACHEATTR { CBLOCK, CTICK, CDATA };
+
+                TableData                            packed;
+                std::vector<size_t>                  offsets;
+                size_t                               total,
+                                                     blockSize;
+                RowNum                               rowNum;
+                mutable std::vector<CachedBlock>     cache;
+                mutable unsigned long                tick;
+                mutable std::mutex                   mtxCache;
+
+                const char*      block(size_t index)                             const noexcept(false);
+};
+
+#endif
+
+// Rows addressable by the replica identity of the table, so single rows can be
+// inserted, replaced or removed in place. The byte offset of every row is kept
+// in a Fenwick tree over the row lengths: an update and the lookup of the row
+// containing an offset both cost O(log rows). Freed slots are reused by inserts.
+// columnData() splits the current rows by column, in the order they are read;
+// rowIndex() indexes them.
+
+class RowStore : public TableStore {
+        public:
+                                 RowStore(const std::string& qualifiedName,
+                                          const ColumnNames& columnNames,
+                                          const std::vector<bool>& keyColumns,
+                                          const ColumnTypes& columnTypes);
+                size_t           size(void)                                      const noexcept(true)  override;
+                RowNum           rows(void)                                      const noexcept(true)  override;
+                size_t           read(char* buf, size_t len, size_t offset)      const noexcept(false) override;
+                size_t           memory(void)                                    const noexcept(true)  override;
+
+                const std::string&  qualified(void)                              const noexcept(true);
+                const ColumnNames&  names(void)                                  const noexcept(true);
+                const ColumnTypes&  types(void)                                  const noexcept(true);
+                void             columnData(ColumnData& cdata)                   const noexcept(false);
+                void             rowIndex(RowIndex& index)                       const noexcept(false);
+                bool             keyless(void)                                   const noexcept(true);
+                bool             put(const Fields& tuple, const Fields* oldKey)        noexcept(false);
+                bool             erase(const Fields& oldKey)                           noexcept(false);
+                void             clear(void)                                           noexcept(true);
+
+        private:
+                typedef std::tuple<std::string, std::vector<uint32_t>>  Row;
+                enum ROWATTR { RTEXT, RENDS };
+
+                std::string                          qualName;
+                ColumnNames                          columns;
+                std::vector<bool>                    keys;
+                ColumnTypes                          colTypes;
+                std::vector<Row>                     slots;
+                std::vector<size_t>                  fenwick,
+                                                     freeSlots;
+                std::unordered_map<RowKey, size_t>   index;
+                size_t                               total,
+                                                     rowNum;
+                mutable std::mutex                   mtxRows;
+
+                bool             makeKey(const Fields& tuple, RowKey& key)       const noexcept(false);
+                int              findField(const Fields& tuple, size_t column)   const noexcept(true);
+                void             setLength(size_t slot, size_t len)                    noexcept(true);
+                size_t           prefix(size_t slot)                             const noexcept(true);
+                size_t           findSlot(size_t offset, size_t& intra)          const noexcept(true);
+};
+
+} // end namespace dbfsutils
+
+#endif
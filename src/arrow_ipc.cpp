@@ -0,0 +1,382 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <arrow_ipc.hpp>
+
+using std::string;
+using std::vector;
+using std::get;
+using std::numeric_limits;
+
+namespace dbfsutils{
+
+FlatBuilder::FlatBuilder(void)
+                     : tableStart{0}{}
+
+uint32_t FlatBuilder::size(void) const noexcept(true){
+     return static_cast<uint32_t>(buf.size());
+}
+
+void FlatBuilder::push(const void* data, size_t len) noexcept(false){
+     const char  *bytes  {static_cast<const char*>(data)};
+     buf.insert(buf.begin(), bytes, bytes + len);
+}
+
+void FlatBuilder::prep(size_t align, size_t extra) noexcept(false){
+     // The positions are counted from the end: the buffer is finished on a multiple of 8,
+     // so a position aligned from the end is aligned from the start too.
+     size_t  pad  {(align - (buf.size() + extra) % align) % align};
+     buf.insert(buf.begin(), pad, '\0');
+}
+
+void FlatBuilder::uoffset(uint32_t target) noexcept(false){
+     prep(sizeof(uint32_t), 0);
+     uint32_t  rel  {size() + static_cast<uint32_t>(sizeof(uint32_t)) - target};
+     push(&rel, sizeof(rel));
+}
+
+uint32_t FlatBuilder::text(const string& value) noexcept(false){
+     uint32_t  len  {static_cast<uint32_t>(value.size())};
+
+     prep(sizeof(uint32_t), value.size() + 1);
+     push("", 1);
+     push(value.data(), value.size());
+     push(&len, sizeof(len));
+     return size();
+}
+
+uint32_t FlatBuilder::offsets(const vector<uint32_t>& items) noexcept(false){
+     uint32_t  count  {static_cast<uint32_t>(items.size())};
+
+     prep(sizeof(uint32_t), items.size() * sizeof(uint32_t));
+     for(size_t i = items.size(); i > 0; i--)
+          uoffset(items[i - 1]);
+     push(&count, sizeof(count));
+     return size();
+}
+
+uint32_t FlatBuilder::structs(const TableData& items, size_t count) noexcept(false){
+     uint32_t  num    {static_cast<uint32_t>(count)};
+
+     // The structs of the Arrow metadata hold 64 bit fields.
+     prep(sizeof(uint32_t), items.size());
+     prep(sizeof(int64_t), items.size());
+     push(items.data(), items.size());
+     push(&num, sizeof(num));
+     return size();
+}
+
+void FlatBuilder::startTable(void) noexcept(true){
+     fields.clear();
+     tableStart = size();
+}
+
+void FlatBuilder::offsetField(uint16_t slot, uint32_t target) noexcept(false){
+     uoffset(target);
+     fields.push_back(FieldPos(slot, size()));
+}
+
+uint32_t FlatBuilder::endTable(void) noexcept(false){
+     int32_t           soffset   {0};
+     prep(sizeof(int32_t), 0);
+     push(&soffset, sizeof(soffset));
+
+     uint32_t          tableEnd  {size()};
+     uint16_t          slots     {0};
+     for(auto &fld : fields)
+          slots = std::max<uint16_t>(slots, get<FSLOT>(fld) + 1);
+
+     // The vtable: its size, the size of the table, then the position of every field in the table.
+     vector<uint16_t>  vtable(slots + 2, 0);
+     vtable[0] = static_cast<uint16_t>(vtable.size() * sizeof(uint16_t));
+     vtable[1] = static_cast<uint16_t>(tableEnd - tableStart);
+     for(auto &fld : fields)
+          vtable[get<FSLOT>(fld) + 2] = static_cast<uint16_t>(tableEnd - get<FPOS>(fld));
+     push(vtable.data(), vtable.size() * sizeof(uint16_t));
+
+     soffset = static_cast<int32_t>(size() - tableEnd);
+     memcpy(buf.data() + size() - tableEnd, &soffset, sizeof(soffset));
+     return tableEnd;
+}
+
+void FlatBuilder::finish(uint32_t root, TableData& out) noexcept(false){
+     prep(sizeof(int64_t), sizeof(uint32_t));
+     uoffset(root);
+     out.swap(buf);
+}
+
+ArrowWriter::ArrowWriter(const ColumnNames& columnNames, const ColumnTypes& columnTypes)
+                     : names{columnNames}, rows{0}{
+     for(size_t c = 0; c < names.size(); c++){
+          ARROWTYPE  type  {ARROW_UTF8};
+          switch(c < columnTypes.size() ? columnTypes[c] : 0){
+               case PG_BOOL:   type = ARROW_BOOL;    break;
+               case PG_INT2:   type = ARROW_INT16;   break;
+               case PG_INT4:   type = ARROW_INT32;   break;
+               case PG_INT8:   type = ARROW_INT64;   break;
+               case PG_FLOAT4: type = ARROW_FLOAT32; break;
+               case PG_FLOAT8: type = ARROW_FLOAT64; break;
+          }
+          columns.push_back(Builder(type, TableData(), TableData(), vector<int64_t>(1, 0), 0));
+     }
+}
+
+void ArrowWriter::setBit(TableData& bits, int64_t index, bool value) noexcept(false){
+     if(static_cast<size_t>(index / 8) >= bits.size()) bits.push_back('\0');
+     if(value) bits[index / 8] = static_cast<char>(bits[index / 8] | (1 << (index % 8)));
+}
+
+void ArrowWriter::append(size_t column, const char* text, size_t len) noexcept(false){
+     Builder     &col     {columns[column]};
+     TableData   &values  {get<BVALUES>(col)};
+     bool        valid    {len != 0};
+     char        num[64];
+
+     if(get<BTYPE>(col) == ARROW_UTF8){
+          values.insert(values.end(), text, text + len);
+          get<BOFFSETS>(col).push_back(static_cast<int64_t>(values.size()));
+          setBit(get<BVALID>(col), rows, true);
+          return;
+     }
+
+     // A number is parsed from a copy terminated by NUL: a value that can't be parsed is null.
+     if(valid && len < sizeof(num)){
+          memcpy(num, text, len);
+          num[len] = '\0';
+     }
+     valid = valid && len < sizeof(num);
+
+     char        *end     {nullptr};
+     switch(get<BTYPE>(col)){
+          case ARROW_BOOL:
+               valid = valid && (num[0] == 't' || num[0] == 'f') && len == 1;
+               setBit(values, rows, valid && num[0] == 't');
+          break;
+          case ARROW_INT16:
+          case ARROW_INT32:
+          case ARROW_INT64:
+          {
+               long long  ival  {valid ? strtoll(num, &end, 10) : 0};
+               valid = valid && *end == '\0';
+               if(!valid) ival = 0;
+               int16_t    i16   {static_cast<int16_t>(ival)};
+               int32_t    i32   {static_cast<int32_t>(ival)};
+               int64_t    i64   {static_cast<int64_t>(ival)};
+               if(get<BTYPE>(col) == ARROW_INT16)      values.insert(values.end(), reinterpret_cast<char*>(&i16), reinterpret_cast<char*>(&i16) + sizeof(i16));
+               else if(get<BTYPE>(col) == ARROW_INT32) values.insert(values.end(), reinterpret_cast<char*>(&i32), reinterpret_cast<char*>(&i32) + sizeof(i32));
+               else                                    values.insert(values.end(), reinterpret_cast<char*>(&i64), reinterpret_cast<char*>(&i64) + sizeof(i64));
+          }
+          break;
+          case ARROW_FLOAT32:
+          case ARROW_FLOAT64:
+          {
+               double     dval  {valid ? strtod(num, &end) : 0.0};
+               valid = valid && *end == '\0';
+               if(!valid) dval = 0.0;
+               float      fval  {static_cast<float>(dval)};
+               if(get<BTYPE>(col) == ARROW_FLOAT32) values.insert(values.end(), reinterpret_cast<char*>(&fval), reinterpret_cast<char*>(&fval) + sizeof(fval));
+               else                                 values.insert(values.end(), reinterpret_cast<char*>(&dval), reinterpret_cast<char*>(&dval) + sizeof(dval));
+          }
+          break;
+          case ARROW_UTF8:
+          break;
+     }
+
+     setBit(get<BVALID>(col), rows, valid);
+     if(!valid) get<BNULLS>(col)++;
+}
+
+void ArrowWriter::endRow(void) noexcept(false){
+     rows++;
+}
+
+void ArrowWriter::padTo(TableData& out, size_t align) noexcept(false){
+     out.insert(out.end(), (align - out.size() % align) % align, '\0');
+}
+
+void ArrowWriter::putInt64(TableData& out, int64_t value) noexcept(false){
+     const char  *bytes  {reinterpret_cast<const char*>(&value)};
+     out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+void ArrowWriter::message(TableData& out, const TableData& meta) noexcept(false){
+     // Encapsulated message: continuation marker, length of the metadata padded to 8, metadata.
+     const char  marker[]  {'\xff', '\xff', '\xff', '\xff'};
+     int32_t     len       {static_cast<int32_t>((meta.size() + 8 + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT - 8)};
+
+     out.insert(out.end(), marker, marker + sizeof(marker));
+     out.insert(out.end(), reinterpret_cast<const char*>(&len), reinterpret_cast<const char*>(&len) + sizeof(len));
+     out.insert(out.end(), meta.begin(), meta.end());
+     padTo(out, ALIGNMENT);
+}
+
+uint32_t ArrowWriter::schema(FlatBuilder& fbb) const noexcept(false){
+     vector<uint32_t>  fields;
+     vector<uint32_t>  none;
+
+     for(size_t c = 0; c < columns.size(); c++){
+          uint32_t  name      {fbb.text(names[c])},
+                    type      {0},
+                    children  {fbb.offsets(none)};
+          uint8_t   typeId    {TYPE_UTF8};
+
+          fbb.startTable();
+          switch(get<BTYPE>(columns[c])){
+               case ARROW_BOOL:    typeId = TYPE_BOOL; break;
+               case ARROW_INT16:   typeId = TYPE_INT; fbb.field<int32_t>(0, 16); fbb.field<uint8_t>(1, 1); break;
+               case ARROW_INT32:   typeId = TYPE_INT; fbb.field<int32_t>(0, 32); fbb.field<uint8_t>(1, 1); break;
+               case ARROW_INT64:   typeId = TYPE_INT; fbb.field<int32_t>(0, 64); fbb.field<uint8_t>(1, 1); break;
+               case ARROW_FLOAT32: typeId = TYPE_FLOAT; fbb.field<int16_t>(0, 1); break;
+               case ARROW_FLOAT64: typeId = TYPE_FLOAT; fbb.field<int16_t>(0, 2); break;
+               case ARROW_UTF8:
+                    if(get<BVALUES>(columns[c]).size() > static_cast<size_t>(numeric_limits<int32_t>::max())) 
+                         typeId = TYPE_LARGE_UTF8;
+               break;
+          }
+          type = fbb.endTable();
+
+          // Field: name, nullable, type_type, type, dictionary, children.
+          fbb.startTable();
+          fbb.offsetField(0, name);
+          fbb.field<uint8_t>(1, 1);
+          fbb.field<uint8_t>(2, typeId);
+          fbb.offsetField(3, type);
+          fbb.offsetField(5, children);
+          fields.push_back(fbb.endTable());
+     }
+
+     uint32_t  list  {fbb.offsets(fields)};
+
+     // Schema: endianness, fields.
+     fbb.startTable();
+     #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+     fbb.field<int16_t>(0, 1);
+     #else
+     fbb.field<int16_t>(0, 0);
+     #endif
+     fbb.offsetField(1, list);
+     return fbb.endTable();
+}
+
+void ArrowWriter::write(TableData& out) const noexcept(false){
+     const char          magic[]  {'A', 'R', 'R', 'O', 'W', '1', '\0', '\0'};
+     TableData           meta,
+                         nodes,
+                         buffers,
+                         blocks;
+     vector<TableData>   offsets(columns.size());
+     vector<const TableData*>  body;
+     int64_t             bodyLen  {0};
+
+     out.insert(out.end(), magic, magic + sizeof(magic));
+
+     // Message: version, header_type, header, bodyLength.
+     {
+          FlatBuilder  fbb;
+          uint32_t     header  {schema(fbb)};
+          fbb.startTable();
+          fbb.field<int16_t>(0, METADATA_V5);
+          fbb.field<uint8_t>(1, HEADER_SCHEMA);
+          fbb.offsetField(2, header);
+          fbb.field<int64_t>(3, 0);
+          fbb.finish(fbb.endTable(), meta);
+          message(out, meta);
+     }
+
+     // The buffers of every column, in the order of the fields: validity, then offsets and 
+     // data for text, values for the others. A validity without nulls is left empty.
+     auto addBuffer = [&](const TableData* data){
+             putInt64(buffers, bodyLen);
+             putInt64(buffers, data != nullptr ? static_cast<int64_t>(data->size()) : 0);
+             if(data == nullptr) return;
+             body.push_back(data);
+             bodyLen += (data->size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+     };
+
+     for(size_t c = 0; c < columns.size(); c++){
+          const Builder  &col  {columns[c]};
+          putInt64(nodes, rows);
+          putInt64(nodes, get<BNULLS>(col));
+          addBuffer(get<BNULLS>(col) != 0 ? &get<BVALID>(col) : nullptr);
+          if(get<BTYPE>(col) == ARROW_UTF8){
+               bool  large  {get<BVALUES>(col).size() > static_cast<size_t>(numeric_limits<int32_t>::max())};
+               for(int64_t off : get<BOFFSETS>(col)){
+                    int32_t  narrow  {static_cast<int32_t>(off)};
+                    if(large) putInt64(offsets[c], off);
+                    else      offsets[c].insert(offsets[c].end(), reinterpret_cast<char*>(&narrow), 
+                                                reinterpret_cast<char*>(&narrow) + sizeof(narrow));
+               }
+               addBuffer(&offsets[c]);
+          }
+          addBuffer(&get<BVALUES>(col));
+     }
+
+     size_t              batchStart  {out.size()};
+     {
+          FlatBuilder  fbb;
+          uint32_t     nodeList  {fbb.structs(nodes, columns.size())},
+                       bufList   {fbb.structs(buffers, buffers.size() / 16)};
+          // RecordBatch: length, nodes, buffers.
+          fbb.startTable();
+          fbb.field<int64_t>(0, rows);
+          fbb.offsetField(1, nodeList);
+          fbb.offsetField(2, bufList);
+          uint32_t     header    {fbb.endTable()};
+          fbb.startTable();
+          fbb.field<int16_t>(0, METADATA_V5);
+          fbb.field<uint8_t>(1, HEADER_BATCH);
+          fbb.offsetField(2, header);
+          fbb.field<int64_t>(3, bodyLen);
+          fbb.finish(fbb.endTable(), meta);
+          message(out, meta);
+     }
+     int32_t             metaLen     {static_cast<int32_t>(out.size() - batchStart)};
+
+     out.reserve(out.size() + bodyLen + 1024);
+     for(auto data : body){
+          out.insert(out.end(), data->begin(), data->end());
+          padTo(out, ALIGNMENT);
+     }
+
+     // Footer: version, schema, dictionaries, recordBatches; a Block is offset, metadata 
+     // length, padding, body length.
+     {
+          FlatBuilder  fbb;
+          int32_t      pad       {0};
+          putInt64(blocks, static_cast<int64_t>(batchStart));
+          blocks.insert(blocks.end(), reinterpret_cast<char*>(&metaLen), reinterpret_cast<char*>(&metaLen) + sizeof(metaLen));
+          blocks.insert(blocks.end(), reinterpret_cast<char*>(&pad), reinterpret_cast<char*>(&pad) + sizeof(pad));
+          putInt64(blocks, bodyLen);
+
+          uint32_t     header    {schema(fbb)},
+                       dicts     {fbb.structs(TableData(), 0)},
+                       batches   {fbb.structs(blocks, 1)};
+          fbb.startTable();
+          fbb.field<int16_t>(0, METADATA_V5);
+          fbb.offsetField(1, header);
+          fbb.offsetField(2, dicts);
+          fbb.offsetField(3, batches);
+          fbb.finish(fbb.endTable(), meta);
+     }
+
+     int32_t             footerLen   {static_cast<int32_t>(meta.size())};
+     out.insert(out.end(), meta.begin(), meta.end());
+     out.insert(out.end(), reinterpret_cast<char*>(&footerLen), reinterpret_cast<char*>(&footerLen) + sizeof(footerLen));
+     out.insert(out.end(), magic, magic + 6);
+}
+
+} // end namespace dbfsutils
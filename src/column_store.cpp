@@ -0,0 +1,529 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <column_store.hpp>
+
+using std::string;
+using std::vector;
+using std::get;
+using std::min;
+using std::upper_bound;
+using std::to_string;
+using std::mutex;
+using std::lock_guard;
+using std::invalid_argument;
+
+namespace dbfsutils{
+
+namespace{
+     const int64_t  USECS_DAY    {86400000000LL};
+     const int64_t  USECS_SEC    {1000000LL};
+
+     // Days from 1970-01-01 of a date of the proleptic Gregorian calendar, and back.
+     int64_t daysFromCivil(int64_t year, int64_t month, int64_t day){
+          year -= month <= 2;
+          int64_t  era  {(year >= 0 ? year : year - 399) / 400},
+                   yoe  {year - era * 400},
+                   doy  {(153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1},
+                   doe  {yoe * 365 + yoe / 4 - yoe / 100 + doy};
+          return era * 146097 + doe - 719468;
+     }
+
+     void civilFromDays(int64_t days, int64_t& year, int64_t& month, int64_t& day){
+          days += 719468;
+          int64_t  era  {(days >= 0 ? days : days - 146096) / 146097},
+                   doe  {days - era * 146097},
+                   yoe  {(doe - doe / 1460 + doe / 36524 - doe / 146096) / 365},
+                   doy  {doe - (365 * yoe + yoe / 4 - yoe / 100)},
+                   mp   {(5 * doy + 2) / 153};
+          day   = doy - (153 * mp + 2) / 5 + 1;
+          month = mp < 10 ? mp + 3 : mp - 9;
+          year  = yoe + era * 400 + (month <= 2);
+     }
+
+     size_t putDigits(int64_t num, size_t digits, char* out){
+          for(size_t d = digits; d > 0; d--){
+               out[d - 1] = static_cast<char>('0' + num % 10);
+               num /= 10;
+          }
+          return digits;
+     }
+
+     bool getDigits(const char*& pos, const char* end, size_t digits, int64_t& num){
+          num = 0;
+          for(size_t d = 0; d < digits; d++, pos++){
+               if(pos >= end || *pos < '0' || *pos > '9') return false;
+               num = num * 10 + (*pos - '0');
+          }
+          return true;
+     }
+}
+
+ColumnStore::ColumnStore(const TableData& tdata, const ColumnTypes& columnTypes, bool escaped)
+                     : total{tdata.size()}, rowNum{0}, tick{0}{
+     if(columnTypes.size() == 0)
+          throw invalid_argument("ColumnStore: no columns");
+
+     for(auto type : columnTypes){
+          VALUEKIND  kind  {KIND_TEXT};
+          switch(type){
+               case PG_BOOL:      kind = KIND_BOOL;      break;
+               case PG_INT2:      kind = KIND_INT16;     break;
+               case PG_INT4:      kind = KIND_INT32;     break;
+               case PG_INT8:      kind = KIND_INT64;     break;
+               case PG_FLOAT4:    kind = KIND_FLOAT32;   break;
+               case PG_FLOAT8:    kind = KIND_FLOAT64;   break;
+               case PG_DATE:      kind = KIND_DATE;      break;
+               case PG_TIME:      kind = KIND_TIME;      break;
+               case PG_TIMESTAMP: kind = KIND_TIMESTAMP; break;
+          }
+          columns.push_back(Column(kind, TableData(), vector<bool>(), RowIndex()));
+     }
+
+     // Every row must be a field for every column, each followed by ';', then '\n': 
+     // the rows are rendered again in the same way.
+     const char  *pos  {tdata.data()},
+                 *end  {tdata.data() + tdata.size()};
+     while(pos < end){
+          size_t  offset  {static_cast<size_t>(pos - tdata.data())};
+          if(blocks.size() == 0 || offset - blocks.back() >= BLOCK_SIZE){
+               blocks.push_back(offset);
+               firstRows.push_back(rowNum);
+          }
+          for(auto &column : columns){
+               const char  *sep  {pos};
+               if(!escaped)
+                    sep = static_cast<const char*>(memchr(pos, ';', end - pos));
+               else
+                    for(; sep < end && *sep != ';'; sep++)
+                         if(*sep == '\\') sep++;
+               if(sep == nullptr || sep >= end)
+                    throw invalid_argument("ColumnStore: missing fields in row " + to_string(rowNum));
+
+               append(column, pos, static_cast<size_t>(sep - pos));
+               pos = sep + 1;
+          }
+          if(pos >= end || *pos != '\n')
+               throw invalid_argument("ColumnStore: extra fields in row " + to_string(rowNum));
+          pos++;
+          rowNum++;
+     }
+
+     for(auto &column : columns){
+          get<CVALUES>(column).shrink_to_fit();
+          get<CNULLS>(column).shrink_to_fit();
+     }
+     blocks.shrink_to_fit();
+     firstRows.shrink_to_fit();
+}
+
+size_t ColumnStore::size(void) const noexcept(true){
+     return total;
+}
+
+RowNum ColumnStore::rows(void) const noexcept(true){
+     return rowNum;
+}
+
+size_t ColumnStore::typed(void) const noexcept(true){
+     return static_cast<size_t>(std::count_if(columns.begin(), columns.end(), 
+                                              [](const Column& column){ return get<CKIND>(column) != KIND_TEXT; }));
+}
+
+size_t ColumnStore::memory(void) const noexcept(true){
+     lock_guard<mutex> lock(mtxCache);
+     size_t  bytes  {blocks.capacity() * sizeof(size_t) + firstRows.capacity() * sizeof(RowNum)};
+
+     for(auto &column : columns)
+          bytes += get<CVALUES>(column).capacity() + get<CNULLS>(column).capacity() / 8 + get<CENDS>(column).memory();
+     for(auto &cached : cache)
+          bytes += get<CDATA>(cached).capacity();
+     return bytes;
+}
+
+size_t ColumnStore::width(VALUEKIND kind) noexcept(true){
+     switch(kind){
+          case KIND_BOOL:      return 1;
+          case KIND_INT16:     return sizeof(int16_t);
+          case KIND_INT32:
+          case KIND_DATE:      return sizeof(int32_t);
+          case KIND_FLOAT32:   return sizeof(float);
+          case KIND_INT64:
+          case KIND_TIME:
+          case KIND_TIMESTAMP: return sizeof(int64_t);
+          case KIND_FLOAT64:   return sizeof(double);
+          case KIND_TEXT:
+          default:             return 0;
+     }
+}
+
+void ColumnStore::putText(Column& column, const char* text, size_t len) noexcept(false){
+     TableData  &heap  {get<CVALUES>(column)};
+     heap.insert(heap.end(), text, text + len);
+     get<CENDS>(column).push(heap.size());
+}
+
+void ColumnStore::append(Column& column, const char* text, size_t len) noexcept(false){
+     char       bin[sizeof(int64_t)]  {};
+     VALUEKIND  kind                  {get<CKIND>(column)};
+
+     if(kind == KIND_TEXT){
+          putText(column, text, len);
+          return;
+     }
+
+     // An empty field is a null.
+     if(len != 0 && !encode(kind, text, len, bin)){
+          demote(column);
+          putText(column, text, len);
+          return;
+     }
+
+     get<CVALUES>(column).insert(get<CVALUES>(column).end(), bin, bin + width(kind));
+     get<CNULLS>(column).push_back(len == 0);
+}
+
+void ColumnStore::demote(Column& column) noexcept(false){
+     TableData  heap;
+     RowIndex   ends;
+     char       buf[VALUE_MAX];
+
+     for(RowNum row = 0; row < get<CNULLS>(column).size(); row++){
+          size_t  len  {value(column, row, buf)};
+          heap.insert(heap.end(), buf, buf + len);
+          ends.push(heap.size());
+     }
+
+     get<CKIND>(column) = KIND_TEXT;
+     get<CVALUES>(column).swap(heap);
+     get<CENDS>(column) = std::move(ends);
+     vector<bool>().swap(get<CNULLS>(column));
+}
+
+size_t ColumnStore::value(const Column& column, RowNum row, char* out) const noexcept(true){
+     VALUEKIND  kind  {get<CKIND>(column)};
+
+     if(get<CNULLS>(column)[row]) return 0;
+     return render(kind, get<CVALUES>(column).data() + row * width(kind), out);
+}
+
+bool ColumnStore::encode(VALUEKIND kind, const char* text, size_t len, char* bin) noexcept(true){
+     char     buf[VALUE_MAX],
+              *end   {nullptr};
+     int64_t  num    {0},
+              usecs  {0};
+
+     if(len >= VALUE_MAX) return false;
+     memcpy(buf, text, len);
+     buf[len] = '\0';
+
+     switch(kind){
+          case KIND_BOOL:
+               bin[0] = buf[0] == 't' ? 1 : 0;
+          break;
+          case KIND_INT16:
+          case KIND_INT32:
+          case KIND_INT64:
+          {
+               if(!getInt(buf, len, num)) return false;
+               int16_t  i16  {static_cast<int16_t>(num)};
+               int32_t  i32  {static_cast<int32_t>(num)};
+               if(kind == KIND_INT16)      memcpy(bin, &i16, sizeof(i16));
+               else if(kind == KIND_INT32) memcpy(bin, &i32, sizeof(i32));
+               else                        memcpy(bin, &num, sizeof(num));
+          }
+          break;
+          case KIND_FLOAT32:
+          {
+               errno = 0;
+               float    fval  {strtof(buf, &end)};
+               if(errno != 0 || *end != '\0') return false;
+               memcpy(bin, &fval, sizeof(fval));
+          }
+          break;
+          case KIND_FLOAT64:
+          {
+               errno = 0;
+               double   dval  {strtod(buf, &end)};
+               if(errno != 0 || *end != '\0') return false;
+               memcpy(bin, &dval, sizeof(dval));
+          }
+          break;
+          case KIND_DATE:
+          {
+               if(!getDate(buf, len, num)) return false;
+               int32_t  days  {static_cast<int32_t>(num)};
+               memcpy(bin, &days, sizeof(days));
+          }
+          break;
+          case KIND_TIME:
+               if(!getTime(buf, len, usecs)) return false;
+               memcpy(bin, &usecs, sizeof(usecs));
+          break;
+          case KIND_TIMESTAMP:
+          {
+               const char  *space  {static_cast<const char*>(memchr(buf, ' ', len))};
+               if(space == nullptr || !getDate(buf, static_cast<size_t>(space - buf), num) ||
+                  !getTime(space + 1, len - static_cast<size_t>(space - buf) - 1, usecs) || usecs >= USECS_DAY) 
+                    return false;
+               usecs += num * USECS_DAY;
+               memcpy(bin, &usecs, sizeof(usecs));
+          }
+          break;
+          case KIND_TEXT:
+          default:
+               return false;
+     }
+
+     // Kept only if rendered back to the same text: a value out of range, written in another
+     // style or with another precision, stays in a column of text.
+     return render(kind, bin, buf) == len && memcmp(buf, text, len) == 0;
+}
+
+size_t ColumnStore::render(VALUEKIND kind, const char* bin, char* out) noexcept(true){
+     int64_t  num  {0};
+
+     switch(kind){
+          case KIND_BOOL:
+               out[0] = bin[0] != 0 ? 't' : 'f';
+               return 1;
+          case KIND_INT16:
+          {
+               int16_t  i16;
+               memcpy(&i16, bin, sizeof(i16));
+               return putInt(i16, out);
+          }
+          case KIND_INT32:
+          {
+               int32_t  i32;
+               memcpy(&i32, bin, sizeof(i32));
+               return putInt(i32, out);
+          }
+          case KIND_INT64:
+               memcpy(&num, bin, sizeof(num));
+               return putInt(num, out);
+          case KIND_FLOAT32:
+          case KIND_FLOAT64:
+          {
+               float    fval  {0};
+               double   dval  {0};
+               if(kind == KIND_FLOAT32){
+                    memcpy(&fval, bin, sizeof(fval));
+                    dval = fval;
+               }else{
+                    memcpy(&dval, bin, sizeof(dval));
+               }
+               // Like the server: NaN, Infinity, then the fewest digits read back as the same value.
+               if(dval != dval){
+                    memcpy(out, "NaN", 3);
+                    return 3;
+               }
+               if(dval == std::numeric_limits<double>::infinity() || dval == -std::numeric_limits<double>::infinity()){
+                    size_t  len  {dval < 0 ? 9u : 8u};
+                    memcpy(out, dval < 0 ? "-Infinity" : "Infinity", len);
+                    return len;
+               }
+               int      len   {0};
+               for(int digits = kind == KIND_FLOAT32 ? 6 : 15; digits <= 17; digits++){
+                    len = snprintf(out, VALUE_MAX, "%.*g", digits, dval);
+                    if(kind == KIND_FLOAT32 ? strtof(out, nullptr) == fval : strtod(out, nullptr) == dval) break;
+               }
+               return static_cast<size_t>(len);
+          }
+          case KIND_DATE:
+          {
+               int32_t  days;
+               memcpy(&days, bin, sizeof(days));
+               return putDate(days, out);
+          }
+          case KIND_TIME:
+               memcpy(&num, bin, sizeof(num));
+               return putTime(num, out);
+          case KIND_TIMESTAMP:
+          {
+               memcpy(&num, bin, sizeof(num));
+               int64_t  days  {num / USECS_DAY - (num % USECS_DAY < 0 ? 1 : 0)};
+               size_t   len   {putDate(days, out)};
+               out[len++] = ' ';
+               return len + putTime(num - days * USECS_DAY, out + len);
+          }
+          case KIND_TEXT:
+          default:
+               return 0;
+     }
+}
+
+size_t ColumnStore::putInt(int64_t num, char* out) noexcept(true){
+     char      digits[24];
+     size_t    count  {0},
+               len    {0};
+     uint64_t  mag    {num < 0 ? 0 - static_cast<uint64_t>(num) : static_cast<uint64_t>(num)};
+
+     do{
+          digits[count++] = static_cast<char>('0' + mag % 10);
+          mag /= 10;
+     }while(mag != 0);
+
+     if(num < 0) out[len++] = '-';
+     while(count != 0) out[len++] = digits[--count];
+     return len;
+}
+
+size_t ColumnStore::putDate(int64_t days, char* out) noexcept(true){
+     int64_t  year, month, day;
+     size_t   len   {0};
+
+     civilFromDays(days, year, month, day);
+     len += putDigits(year, year > 9999 ? to_string(year).size() : 4, out);
+     out[len++] = '-';
+     len += putDigits(month, 2, out + len);
+     out[len++] = '-';
+     len += putDigits(day, 2, out + len);
+     return len;
+}
+
+size_t ColumnStore::putTime(int64_t usecs, char* out) noexcept(true){
+     int64_t  secs  {usecs / USECS_SEC},
+              frac  {usecs % USECS_SEC};
+     size_t   len   {0};
+
+     len += putDigits(secs / 3600, 2, out);
+     out[len++] = ':';
+     len += putDigits(secs / 60 % 60, 2, out + len);
+     out[len++] = ':';
+     len += putDigits(secs % 60, 2, out + len);
+
+     // The fraction without its trailing zeros.
+     if(frac != 0){
+          out[len++] = '.';
+          len += putDigits(frac, 6, out + len);
+          while(out[len - 1] == '0') len--;
+     }
+     return len;
+}
+
+bool ColumnStore::getInt(const char* text, size_t len, int64_t& num) noexcept(true){
+     char       *end   {nullptr};
+
+     errno = 0;
+     num   = strtoll(text, &end, 10);
+     return errno == 0 && end == text + len;
+}
+
+bool ColumnStore::getDate(const char* text, size_t len, int64_t& days) noexcept(true){
+     const char  *pos    {text},
+                 *end    {text + len},
+                 *dash   {static_cast<const char*>(memchr(text, '-', len))};
+     int64_t     year, month, day;
+
+     if(dash == nullptr || dash - text < 4 || dash - text > 9) return false;
+     if(!getDigits(pos, end, static_cast<size_t>(dash - text), year) || pos >= end || *pos++ != '-' ||
+        !getDigits(pos, end, 2, month) || pos >= end || *pos++ != '-' || 
+        !getDigits(pos, end, 2, day) || pos != end)
+          return false;
+     if(year < 1 || month < 1 || month > 12 || day < 1 || day > 31) return false;
+
+     days = daysFromCivil(year, month, day);
+     return true;
+}
+
+bool ColumnStore::getTime(const char* text, size_t len, int64_t& usecs) noexcept(true){
+     const char  *pos    {text},
+                 *end    {text + len};
+     int64_t     hours, minutes, secs, frac  {0};
+     size_t      digits  {0};
+
+     if(!getDigits(pos, end, 2, hours) || pos >= end || *pos++ != ':' ||
+        !getDigits(pos, end, 2, minutes) || pos >= end || *pos++ != ':' || 
+        !getDigits(pos, end, 2, secs))
+          return false;
+     if(pos < end){
+          if(*pos++ != '.') return false;
+          digits = static_cast<size_t>(end - pos);
+          if(digits == 0 || digits > 6 || !getDigits(pos, end, digits, frac)) return false;
+          for(; digits < 6; digits++) frac *= 10;
+     }
+     if(hours > 24 || minutes > 59 || secs > 59) return false;
+
+     usecs = ((hours * 60 + minutes) * 60 + secs) * USECS_SEC + frac;
+     return true;
+}
+
+const TableData& ColumnStore::block(size_t index) const noexcept(false){
+     tick++;
+     for(auto &cached : cache){
+          if(get<CBLOCK>(cached) == index){
+               get<CTICK>(cached) = tick;
+               return get<CDATA>(cached);
+          }
+     }
+
+     size_t victim {0};
+     if(cache.size() < BLOCK_CACHE){
+          victim = cache.size();
+          cache.push_back(CachedBlock(index, tick, TableData()));
+     }else{
+          for(size_t c = 1; c < cache.size(); c++)
+               if(get<CTICK>(cache[c]) < get<CTICK>(cache[victim])) victim = c;
+          get<CBLOCK>(cache[victim]) = index;
+          get<CTICK>(cache[victim])  = tick;
+     }
+
+     TableData  &out    {get<CDATA>(cache[victim])};
+     RowNum     first   {firstRows[index]},
+                last    {index + 1 < firstRows.size() ? firstRows[index + 1] : rowNum};
+     char       buf[VALUE_MAX];
+
+     out.clear();
+     out.reserve((index + 1 < blocks.size() ? blocks[index + 1] : total) - blocks[index]);
+     for(RowNum row = first; row < last; row++){
+          for(auto &column : columns){
+               if(get<CKIND>(column) == KIND_TEXT){
+                    const TableData  &heap  {get<CVALUES>(column)};
+                    out.insert(out.end(), heap.data() + get<CENDS>(column).start(row), 
+                                          heap.data() + get<CENDS>(column).start(row + 1));
+               }else{
+                    out.insert(out.end(), buf, buf + value(column, row, buf));
+               }
+               out.push_back(';');
+          }
+          out.push_back('\n');
+     }
+     return out;
+}
+
+size_t ColumnStore::read(char* buf, size_t len, size_t offset) const noexcept(false){
+     lock_guard<mutex> lock(mtxCache);
+
+     if(offset >= total) return 0;
+
+     size_t count  {min(len, total - offset)},
+            done   {0};
+
+     while(done < count){
+          size_t           index  {static_cast<size_t>(upper_bound(blocks.begin(), blocks.end(), offset + done) - blocks.begin()) - 1},
+                           intra  {offset + done - blocks[index]};
+          const TableData  &data  {block(index)};
+          size_t           chunk  {min(count - done, data.size() - intra)};
+
+          std::copy(data.data() + intra, data.data() + intra + chunk, buf + done);
+          done += chunk;
+     }
+     return count;
+}
+
+} // end namespace dbfsutils
@@ -19,13 +19,33 @@
 
 using std::string;
 using std::vector;
+using std::map;
 using std::make_tuple;
 using std::endl;
 using std::get;
 using std::ifstream;
+using std::istringstream;
+using std::find;
 using std::getline;
 using std::to_string;
 using std::unique_ptr;
+using std::pair;
+using std::make_pair;
+using std::min;
+using std::numeric_limits;
+using std::stable_sort;
+using std::atomic;
+using std::mutex;
+using std::lock_guard;
+using std::thread;
+using std::exception_ptr;
+using std::current_exception;
+using std::rethrow_exception;
+using std::make_shared;
+using std::move;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
 
 using syslogwrp::Syslog; 
 
@@ -51,7 +71,7 @@ string DbConnExc::what() const noexcept(true){
 }
 
 PsqlConnection::PsqlConnection(Syslog *slog)
-                     : DbConnection{slog}, conn{nullptr}{
+                     : DbConnection{slog}, conn{nullptr}, loaders{1}, loadMode{LOAD_SELECT}, fetchRows{10000}, changeCheck{CHECK_NONE}, rowStore{false}, lazy{false}, columnFiles{false}, rowIndex{false}, keepNames{false}, storeEngine{ENGINE_FLAT}{
       #ifdef __GNUC__
       #pragma GCC diagnostic push
       #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
@@ -69,70 +89,315 @@ PsqlConnection::PsqlConnection(Syslog *slog)
 }
 
 PsqlConnection::~PsqlConnection(){
+        closePool();
         PQfinish(conn);
 }
 
 void PsqlConnection::reset(void){
+        closePool();
         if(conn != nullptr) PQreset(conn);
 }
 
+void PsqlConnection::setLoaders(size_t num) noexcept(true){
+        loaders = num == 0 ? 1 : num;
+}
+
+void PsqlConnection::setLoadMode(LOADMODE mode) noexcept(true){
+        loadMode = mode;
+}
+
+void PsqlConnection::setFetchRows(size_t rows) noexcept(true){
+        fetchRows = rows == 0 ? 1 : rows;
+}
+
+void PsqlConnection::setChangeCheck(CHANGECHECK check) noexcept(true){
+        changeCheck = check;
+}
+
+void PsqlConnection::setRowStore(bool enable) noexcept(true){
+        rowStore = enable;
+}
+
+void PsqlConnection::setSnapshot(const string& snapshot) noexcept(true){
+        importSnapshot = snapshot;
+}
+
+void PsqlConnection::setLazy(bool enable) noexcept(true){
+        lazy = enable;
+}
+
+void PsqlConnection::setStoreEngine(STOREENGINE engine) noexcept(true){
+        storeEngine = engine;
+}
+
+void PsqlConnection::setColumnFiles(bool enable) noexcept(true){
+        columnFiles = enable;
+}
+
+void PsqlConnection::setRowIndex(bool enable) noexcept(true){
+        rowIndex = enable;
+}
+
+void PsqlConnection::setColumnNames(bool enable) noexcept(true){
+        keepNames = enable;
+}
+
 void PsqlConnection::connect(string dbname, string user, string hostAddr, string port, string pwd) noexcept(false){
-        connectionString  = "dbname=" + dbname +  " user=" + user + " password=" + pwd + \
-                          " hostaddr=" + hostAddr + " port=" + port;
-        conn              = PQconnectdb(connectionString.c_str());
-        if(PQstatus(conn) == CONNECTION_BAD)
-                throw DbConnExc("Connection Error");
+        // An empty password is left out: "password= hostaddr=..." would make the rest its value.
+        connect("dbname=" + dbname +  " user=" + user + (pwd.size() != 0 ? " password=" + pwd : "") + \
+                " hostaddr=" + hostAddr + " port=" + port);
 }
 
 void PsqlConnection::connect(string dbname, string user, string hostAddr) noexcept(false){
+        connect("dbname=" + dbname +  " user=" + user + " hostaddr=" + hostAddr);
+}
+
+void PsqlConnection::connect(const string& connString) noexcept(false){
+        // Every refresh connects again: with the same parameters a working connection and
+        // the pool, maybe in use by a lazy load, are kept.
+        if(conn != nullptr && PQstatus(conn) == CONNECTION_OK && connString == connectionParams()) return;
+
+        closePool();
+        PQfinish(conn);
 
-        connectionString  = "dbname=" + dbname +  " user=" + user + " hostaddr=" + hostAddr;
-        conn              = PQconnectdb(connectionString.c_str());
+        {
+            lock_guard<mutex> lock(mtxConfig);
+            connectionString  = connString;
+        }
+        conn              = PQconnectdb(connString.c_str());
         if(PQstatus(conn) == CONNECTION_BAD)
                 throw DbConnExc("Connection Error");
 }
 
+string PsqlConnection::connectionParams(void) noexcept(false){
+        lock_guard<mutex> lock(mtxConfig);
+        return connectionString;
+}
+
+TableOptions PsqlConnection::tableOptions(const TableName& tableName) noexcept(false){
+        lock_guard<mutex> lock(mtxConfig);
+        auto tableIt = tableConfig.find(tableName);
+        return tableIt != tableConfig.end() ? tableIt->second : TableOptions();
+}
+
+PGconn* PsqlConnection::getPooled(void) noexcept(false){
+        {
+            lock_guard<mutex> lock(mtxPool);
+            while(!pool.empty()){
+                PGconn *pconn {pool.back()};
+                pool.pop_back();
+                if(PQstatus(pconn) == CONNECTION_OK) return pconn;
+                PQfinish(pconn);
+            }
+        }
+
+        PGconn *pconn {PQconnectdb(connectionParams().c_str())};
+        if(PQstatus(pconn) == CONNECTION_BAD){
+                PQfinish(pconn);
+                throw DbConnExc("Connection Error");
+        }
+        return pconn;
+}
+
+void PsqlConnection::putPooled(PGconn* pconn) noexcept(true){
+        if(PQstatus(pconn) != CONNECTION_OK || PQtransactionStatus(pconn) != PQTRANS_IDLE){
+                PQfinish(pconn);
+                return;
+        }
+        lock_guard<mutex> lock(mtxPool);
+        pool.push_back(pconn);
+}
+
+void PsqlConnection::closePool(void) noexcept(true){
+        lock_guard<mutex> lock(mtxPool);
+        for(auto pconn : pool)
+                PQfinish(pconn);
+        pool.clear();
+}
+
+void PsqlConnection::execCmd(PGconn* pconn, const string& cmd) noexcept(false){
+        PGresult       *result {PQexec(pconn, cmd.c_str())};
+        ExecStatusType status  {PQresultStatus(result)};
+        PQclear(result);
+
+        if(status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK)
+                throw DbConnExc(string("Command Error: ").append(cmd).append(" : ").append(PQerrorMessage(pconn)));
+}
+
 void PsqlConnection::loadTable(TableName tableName, TableAttr& tableAttr) noexcept(false){
-     int             retRows          {0},
-                     retFields        {0};
-     const string    listContPrefix   {"select * from "};
-     string          cmdBuff          {listContPrefix + tableName},
-                     errBuff          {""};
+     loadTable(conn, tableName, tableAttr);
+}
+
+void PsqlConnection::loadTable(PGconn* pconn, TableName tableName, TableAttr& tableAttr) noexcept(false){
+     if(rowStore){
+          loadTableRows(pconn, tableName, tableAttr);
+          return;
+     }
+
+     TableData       tdata;
+     ColumnNames     names;
+     ColumnTypes     types;
+     ColumnData      cdata;
+     auto            index            {make_shared<RowIndex>()};
+
+     // The values of every column are also kept on their own, in the order of the rows.
+     if(columnFiles || keepNames || storeEngine == ENGINE_COLUMNAR)
+          columnNames(pconn, tableName, names, types);
+     if(columnFiles)
+          cdata.resize(names.size());
+
+     RowNum          rows             {queryRows(pconn, "select * from " + tableName, tdata, columnFiles ? &cdata : nullptr,
+                                                 rowIndex ? index.get() : nullptr)};
+
+     get<DATA>(tableAttr) = makeStore(move(tdata), rows, types);
+     get<COLS>(tableAttr) = columnFiles || keepNames ? makeColumns(names, types, move(cdata), rows) : ColumnsPtr();
+     get<RIDX>(tableAttr) = rowIndex ? RowIndexPtr(index) : RowIndexPtr();
+     indexTable(tableName, tableAttr);
+     stampTable(tableAttr, rows);
+}
+
+RowNum PsqlConnection::queryRows(PGconn* pconn, const string& query, TableData& tdata, ColumnData* cdata, 
+                                 RowIndex* index) noexcept(false){
+     switch(loadMode){
+          case LOAD_COPY:
+                return copyRows(pconn, query, tdata, cdata, index);
+          case LOAD_CURSOR:
+                return cursorRows(pconn, query, tdata, cdata, index);
+          case LOAD_SELECT:
+          default:
+                return selectRows(pconn, query, tdata, cdata, index);
+     }
+}
+
+void PsqlConnection::columnNames(PGconn* pconn, const TableName& tableName, ColumnNames& names, ColumnTypes& types) noexcept(false){
+     const string    cmdBuff          {"select * from " + tableName + " limit 0"};
+     PGresult        *result          {PQexec(pconn, cmdBuff.c_str())};
+
+     if(PQresultStatus(result) != PGRES_TUPLES_OK){
+          string errBuff {PQerrorMessage(pconn)};
+          PQclear(result);
+          throw DbConnExc(string("Columns Error: ").append(tableName).append(" : ").append(errBuff));
+     }
+
+     names.clear();
+     types.clear();
+     for(int f = 0; f < PQnfields(result); f++){
+          names.push_back(PQfname(result, f));
+          types.push_back(PQftype(result, f));
+     }
+     PQclear(result);
+}
 
-     PGresult        *result          {PQexecParams(conn, cmdBuff.c_str(), 0, nullptr, nullptr, nullptr, nullptr, 0)};
-     TableData&      tdata            {get<DATA>(tableAttr)};
+ColumnsPtr PsqlConnection::makeColumns(const ColumnNames& names, const ColumnTypes& types, ColumnData&& cdata, 
+                                       RowNum rows) noexcept(false){
+     auto            cols             {make_shared<Columns>()};
+
+     // Without column files only the names are kept.
+     cdata.resize(names.size());
+     for(size_t c = 0; c < names.size(); c++){
+          cols->push_back(Column(names[c], columnFiles ? makeStore(move(cdata[c]), rows) : StorePtr(), 
+                                 c < types.size() ? types[c] : 0));
+          TableData().swap(cdata[c]);
+     }
+
+     return cols;
+}
+
+void PsqlConnection::stampTable(TableAttr& tableAttr, RowNum rows) noexcept(true){
      Stat&           thisStat         {get<SSTAT>(tableAttr)};
      struct timeval  ltime;
      struct timespec lbuff;
-   
+
+     get<RNUM>(tableAttr)  = rows;
+     thisStat              = statTempl;
+
+     gettimeofday(&ltime, nullptr);
+     lbuff.tv_sec      = ltime.tv_sec;
+     lbuff.tv_nsec     = ltime.tv_usec * 1000;
+     thisStat.st_atim  = lbuff;
+     thisStat.st_mtim  = lbuff;
+     thisStat.st_ctim  = lbuff;
+
+     thisStat.st_size  = get<DATA>(tableAttr) ? get<DATA>(tableAttr)->size() : 0;
+}
+
+StorePtr PsqlConnection::makeStore(TableData&& tdata, RowNum rows, const ColumnTypes& types) noexcept(false){
+     switch(storeEngine){
+          case ENGINE_COLUMNAR:
+                // Only the tables: the files of the columns, without types, stay flat.
+                if(types.size() != 0){
+                      try{
+                            auto store {make_shared<ColumnStore>(tdata, types, loadMode == LOAD_COPY)};
+                            DBFS_LOG(syslog, LOG_DEBUG, {"- makeStore : columnar: rows: ", to_string(store->rows()), 
+                                                         " - typed columns: ", to_string(store->typed()), "/", to_string(types.size()),
+                                                         " - bytes: ", to_string(tdata.size()), " -> ", to_string(store->memory())});
+                            return store;
+                      }catch(std::invalid_argument& ex){
+                            DBFS_LOG(syslog, LOG_INFO, {"- makeStore : kept flat: ", ex.what()});
+                      }
+                }
+                return make_shared<FlatStore>(move(tdata), rows);
+          #ifdef HAVE_LIBLZ4
+          case ENGINE_LZ4:
+                return make_shared<BlockStore>(move(tdata), rows);
+          #endif
+          #ifdef SYS_memfd_create
+          case ENGINE_MEMFD:
+                if(tdata.size() == 0)
+                      return make_shared<FlatStore>(move(tdata), rows);
+                try{
+                      auto mapped {MappedFile::fromData(tdata)};
+                      return make_shared<MappedStore>(mapped, 0, mapped->size(), rows, true);
+                }catch(std::runtime_error& ex){
+                      throw DbConnExc(string("Store Error: ").append(ex.what()));
+                }
+          #endif
+          case ENGINE_FLAT:
+          default:
+                return make_shared<FlatStore>(move(tdata), rows);
+     }
+}
+
+size_t PsqlConnection::appendRows(PGresult* result, TableData& tdata, ColumnData* cdata, RowIndex* index) noexcept(false){
+     int             retRows          {PQntuples(result)},
+                     retFields        {PQnfields(result)};
+     size_t          start            {tdata.size()};
+
+     if(cdata != nullptr && cdata->size() < static_cast<size_t>(retFields)) 
+          cdata->resize(retFields);
+
+     for(int r = 0; r < retRows; r++) {
+         for(int f = 0; f < retFields; f++){
+             char*  rowdata = PQgetvalue(result, r, f);
+             int    len     = PQgetlength(result, r, f);
+             tdata.insert(tdata.end(), rowdata, rowdata + len);
+             tdata.push_back(';');
+             if(cdata != nullptr){
+                 (*cdata)[f].insert((*cdata)[f].end(), rowdata, rowdata + len);
+                 (*cdata)[f].push_back('\n');
+             }
+             DBFS_LOG(syslog, LOG_DEBUG, {"- loadTable : Loading Table: ", rowdata});
+         }
+         tdata.push_back('\n');
+         if(index != nullptr) index->push(tdata.size());
+     }
+
+     return tdata.size() - start;
+}
+
+RowNum PsqlConnection::selectRows(PGconn* pconn, const string& query, TableData& tdata, ColumnData* cdata, 
+                                  RowIndex* index) noexcept(false){
+     int             retRows          {0};
+     string          errBuff          {""};
+
+     PGresult        *result          {PQexecParams(pconn, query.c_str(), 0, nullptr, nullptr, nullptr, nullptr, 0)};
 
      switch(PQresultStatus(result)) {
           case PGRES_TUPLES_OK:
           case PGRES_COMMAND_OK:
                 retRows   = PQntuples(result);
-                retFields = PQnfields(result);
-    
-                get<RNUM>(tableAttr)  = retRows;
-                thisStat              =  statTempl;
-
-                gettimeofday(&ltime, nullptr);
-                lbuff.tv_sec      = ltime.tv_sec;
-                lbuff.tv_nsec     = ltime.tv_usec * 1000;
-                thisStat.st_atim  = lbuff;
-                thisStat.st_mtim  = lbuff;
-                thisStat.st_ctim  = lbuff;
-
-                for(int r = 0; r < retRows; r++) {
-                    for(int f = 0; f < retFields; f++){
-                        char*  rowdata = PQgetvalue(result, r, f);
-                        tdata.insert(tdata.end(), rowdata, rowdata + strlen(rowdata));
-                        tdata.push_back(';');
-                        syslog->log(LOG_DEBUG, {"- loadTable : Loading Table: ", rowdata});
-                    }
-                    tdata.push_back('\n');
-                }
 
-                thisStat.st_size = tdata.size();
+                appendRows(result, tdata, cdata, index);
           break;
           case PGRES_EMPTY_QUERY:
                         errBuff = "Empty Query: ";
@@ -141,13 +406,605 @@ void PsqlConnection::loadTable(TableName tableName, TableAttr& tableAttr) noexce
           case PGRES_BAD_RESPONSE:
           case PGRES_FATAL_ERROR:
           default:
-                        throw DbConnExc(string("Query Error: ").append(errBuff).append(string(PQerrorMessage(conn))));
+                        PQclear(result);
+                        throw DbConnExc(string("Query Error: ").append(errBuff).append(string(PQerrorMessage(pconn))));
        }
        PQclear(result);
+
+       return retRows;
+}
+
+RowNum PsqlConnection::copyRows(PGconn* pconn, const string& query, TableData& tdata, ColumnData* cdata, 
+                                RowIndex* index) noexcept(false){
+     const string    cmdBuff          {"copy (" + query + ") to stdout (delimiter ';', null '')"};
+     RowNum          rows             {0};
+     char            *row             {nullptr};
+     int             len              {0};
+
+     PGresult        *result          {PQexec(pconn, cmdBuff.c_str())};
+     if(PQresultStatus(result) != PGRES_COPY_OUT){
+          PQclear(result);
+          throw DbConnExc(string("Copy Error: ").append(string(PQerrorMessage(pconn))));
+     }
+     PQclear(result);
+
+     // Every buffer returned by PQgetCopyData is exactly one row, '\n' terminated:
+     // the only per-row work left is appending the trailing field separator.
+     while((len = PQgetCopyData(pconn, &row, 0)) > 0){
+          tdata.insert(tdata.end(), row, row + len - 1);
+          tdata.push_back(';');
+          tdata.push_back('\n');
+          if(index != nullptr) index->push(tdata.size());
+
+          // The separators inside the values are escaped by a backslash, like the backslash itself.
+          if(cdata != nullptr){
+               const char  *field  {row},
+                           *end    {row + len - 1};
+               size_t      col     {0};
+               for(const char *pos = row; pos <= end; pos++){
+                    if(pos < end && *pos == '\\'){
+                         if(pos + 1 < end) pos++;
+                         continue;
+                    }
+                    if(pos != end && *pos != ';') continue;
+
+                    if(cdata->size() <= col) cdata->resize(col + 1);
+                    (*cdata)[col].insert((*cdata)[col].end(), field, pos);
+                    (*cdata)[col].push_back('\n');
+                    field = pos + 1;
+                    col++;
+               }
+          }
+          PQfreemem(row);
+          rows++;
+     }
+
+     bool            copyOk           {len == -1};
+     while((result = PQgetResult(pconn)) != nullptr){
+          if(PQresultStatus(result) != PGRES_COMMAND_OK) copyOk = false;
+          PQclear(result);
+     }
+     if(!copyOk)
+          throw DbConnExc(string("Copy Error: ").append(string(PQerrorMessage(pconn))));
+
+     return rows;
+}
+
+RowNum PsqlConnection::estimateRows(PGconn* pconn, const string& query) noexcept(false){
+     const string    cmdBuff          {"explain " + query};
+     PGresult        *result          {PQexec(pconn, cmdBuff.c_str())};
+     RowNum          rows             {0};
+
+     // The first line of the plan is its top node: "... (cost=a..b rows=n width=w)".
+     if(PQresultStatus(result) != PGRES_TUPLES_OK){
+          string errBuff {PQerrorMessage(pconn)};
+          PQclear(result);
+          throw DbConnExc(string("Explain Error: ").append(errBuff));
+     }
+     if(PQntuples(result) > 0){
+          const char  *found  {strstr(PQgetvalue(result, 0, 0), " rows=")};
+          if(found != nullptr) rows = strtoull(found + 6, nullptr, 10);
+     }
+     PQclear(result);
+
+     return rows;
+}
+
+RowNum PsqlConnection::cursorRows(PGconn* pconn, const string& query, TableData& tdata, ColumnData* cdata, 
+                                  RowIndex* index) noexcept(false){
+     const bool      ownTx            {PQtransactionStatus(pconn) == PQTRANS_IDLE};
+     const string    fetchCmd         {"fetch forward " + to_string(fetchRows) + " from dbfs_cursor"};
+     const size_t    start            {tdata.size()};
+     RowNum          rows             {0},
+                     estimate         {0};
+
+     // A cursor needs a transaction: if the connection is already inside
+     // the shared snapshot transaction of a parallel load, the cursor joins it.
+     if(ownTx) execCmd(pconn, "begin transaction read only");
+
+     try{
+         estimate = estimateRows(pconn, query);
+         execCmd(pconn, "declare dbfs_cursor no scroll cursor for " + query);
+
+         for(size_t batch = fetchRows; batch == fetchRows; ){
+              PGresult  *result  {PQexec(pconn, fetchCmd.c_str())};
+              if(PQresultStatus(result) != PGRES_TUPLES_OK){
+                   PQclear(result);
+                   throw DbConnExc(string("Fetch Error: ").append(string(PQerrorMessage(pconn))));
+              }
+
+              batch               = PQntuples(result);
+              size_t batchBytes   {appendRows(result, tdata, cdata, index)};
+              PQclear(result);
+
+              // After the first batch the cache is sized once, from the rows estimated by the planner
+              // and the bytes of the rows read, plus 1/8: growing it by doubling would hold it twice 
+              // while it's moved, and leave up to half of it unused.
+              if(rows == 0 && batch == fetchRows && estimate > batch){
+                   size_t  expected  {static_cast<size_t>(static_cast<double>(batchBytes) / batch * estimate * 1.125)};
+                   if(start + expected > tdata.capacity()) tdata.reserve(start + expected);
+              }
+              rows               += batch;
+
+              DBFS_LOG(syslog, LOG_INFO, {"- cursorRows : query: ", query, " - batch rows: ", to_string(batch), 
+                                          " - batch bytes: ", to_string(batchBytes), " - cache bytes: ", to_string(tdata.size()), 
+                                          " - cache capacity: ", to_string(tdata.capacity())});
+         }
+
+         execCmd(pconn, "close dbfs_cursor");
+     }catch(...){
+         if(ownTx) PQclear(PQexec(pconn, "rollback"));
+         throw;
+     }
+
+     if(ownTx) execCmd(pconn, "commit");
+
+     // Shrinking copies the cache too: it's done only when more than 1/8 of it is unused.
+     if(tdata.capacity() - tdata.size() > tdata.size() / 8) tdata.shrink_to_fit();
+
+     DBFS_LOG(syslog, LOG_NOTICE, {"- cursorRows : query: ", query, " - rows: ", to_string(rows), " - estimated rows: ", 
+                                   to_string(estimate), " - cache bytes: ", to_string(tdata.size()), 
+                                   " - cache capacity: ", to_string(tdata.capacity())});
+     return rows;
+}
+
+void PsqlConnection::loadTableRows(PGconn* pconn, TableName tableName, TableAttr& tableAttr) noexcept(false){
+     const string    identQuery       {"select quote_ident(n.nspname) || '.' || quote_ident(c.relname), quote_ident(a.attname), "
+                                       "c.relreplident = 'f' or exists(select 1 from pg_index i where i.indrelid = c.oid "
+                                       "and a.attnum = any(i.indkey) and ((c.relreplident = 'd' and i.indisprimary) or "
+                                       "(c.relreplident = 'i' and i.indisreplident))), a.atttypid "
+                                       "from pg_class c join pg_namespace n on n.oid = c.relnamespace "
+                                       "join pg_attribute a on a.attrelid = c.oid "
+                                       "where c.oid = $1::regclass and a.attnum > 0 and not a.attisdropped order by a.attnum"};
+     const string    cmdBuff          {"select * from " + tableName};
+     const char      *params[1]       {tableName.c_str()};
+     string          qualName;
+     ColumnNames     columns;
+     ColumnTypes     types;
+     vector<bool>    keys;
+
+     PGresult        *result          {PQexecParams(pconn, identQuery.c_str(), 1, nullptr, params, nullptr, nullptr, 0)};
+     if(PQresultStatus(result) != PGRES_TUPLES_OK || PQntuples(result) == 0){
+          PQclear(result);
+          throw DbConnExc(string("Identity Error: ").append(tableName).append(" : ").append(PQerrorMessage(pconn)));
+     }
+     qualName = PQgetvalue(result, 0, 0);
+     for(int r = 0; r < PQntuples(result); r++){
+          columns.push_back(PQgetvalue(result, r, 1));
+          keys.push_back(string(PQgetvalue(result, r, 2)) == "t");
+          types.push_back(static_cast<unsigned int>(strtoul(PQgetvalue(result, r, 3), nullptr, 10)));
+     }
+     PQclear(result);
+
+     auto            store            {make_shared<RowStore>(qualName, columns, keys, types)};
+     Fields          tuple(columns.size());
+
+     result = PQexecParams(pconn, cmdBuff.c_str(), 0, nullptr, nullptr, nullptr, nullptr, 0);
+     if(PQresultStatus(result) != PGRES_TUPLES_OK || PQnfields(result) != static_cast<int>(columns.size())){
+          PQclear(result);
+          throw DbConnExc(string("Query Error: ").append(string(PQerrorMessage(pconn))));
+     }
+
+     for(int r = 0; r < PQntuples(result); r++){
+          for(size_t f = 0; f < columns.size(); f++){
+               int col {static_cast<int>(f)};
+               tuple[f] = Field(columns[f], string(PQgetvalue(result, r, col), PQgetlength(result, r, col)), 
+                                PQgetisnull(result, r, col) ? FIELD_NULL : FIELD_VALUE);
+          }
+          store->put(tuple, nullptr);
+     }
+     PQclear(result);
+
+     DBFS_LOG(syslog, LOG_DEBUG, {"- loadTableRows : table: ", tableName, " - identity: ", qualName, 
+                                  store->keyless() ? " - no replica identity" : ""});
+
+     get<DATA>(tableAttr) = store;
+     get<COLS>(tableAttr) = columnFiles ? rowColumns(*store) : 
+                            keepNames   ? makeColumns(store->names(), store->types(), ColumnData(), store->rows()) : ColumnsPtr();
+     get<RIDX>(tableAttr) = rowIndex ? rowOffsets(*store) : RowIndexPtr();
+     indexTable(tableName, tableAttr);
+     stampTable(tableAttr, store->rows());
+}
+
+TableVersion PsqlConnection::probeVersion(TableName tableName) noexcept(true){
+        const string   statsQuery   {"select concat_ws('/', n_tup_ins, n_tup_upd, n_tup_del, pg_relation_filenode(relid)) "
+                                     "from pg_stat_user_tables where relid = $1::regclass"};
+        const string   xminQuery    {"select count(*) || '/' || coalesce(sum(xmin::text::bigint), 0) from " + tableName};
+        const char     *params[1]   {tableName.c_str()};
+        TableVersion   version      {""};
+        PGresult       *result      {nullptr};
+
+        switch(changeCheck){
+             case CHECK_STATS:
+                   result = PQexecParams(conn, statsQuery.c_str(), 1, nullptr, params, nullptr, nullptr, 0);
+             break;
+             case CHECK_XMIN:
+                   result = PQexec(conn, xminQuery.c_str());
+             break;
+             case CHECK_NONE:
+             default:
+                   return version;
+        }
+
+        if(PQresultStatus(result) == PGRES_TUPLES_OK && PQntuples(result) == 1)
+                version = PQgetvalue(result, 0, 0);
+        PQclear(result);
+
+        return version;
+}
+
+void PsqlConnection::loadTables(TableList& db, const TableNames& names) noexcept(false){
+        // The tables named by a request (NOTIFY, TTL, replication) are loaded again even if their
+        // version looks the same: the pg_stat counters of CHECK_STATS are flushed asynchronously.
+        loadTables(db, names, false);
+}
+
+void PsqlConnection::loadTables(TableList& db, const TableNames& names, bool checkVersion) noexcept(false){
+        TableNames                    changed,
+                                      loaded;
+        map<TableName, TableVersion>  versions;
+        const TableNames              *toLoad   {&names};
+
+        // Lazy mode: the tables never read are only listed, their data is fetched 
+        // by fetchTable() at the first access. Only the tables already in memory are reloaded.
+        if(lazy){
+                for(auto &name : names){
+                        auto tableIt {db.find(name)};
+                        if(tableIt != db.end() && get<DATA>(tableIt->second)){
+                                loaded.push_back(name);
+                        }else if(tableIt == db.end()){
+                                TableAttr &tableAttr {db[name]};
+                                stampTable(tableAttr, 0);
+                        }
+                }
+                toLoad = &loaded;
+        }
+
+        for(auto &name : *toLoad){
+                TableVersion version {probeVersion(name)};
+                auto         tableIt {db.find(name)};
+
+                if(checkVersion && tableIt != db.end() && version.size() != 0 && get<VERS>(tableIt->second) == version){
+                        DBFS_LOG(syslog, LOG_DEBUG, {"- loadTables : unchanged table: ", name, " - version: ", version});
+                        continue;
+                }
+
+                db[name];
+                versions[name] = version;
+                changed.push_back(name);
+        }
+
+        DBFS_LOG(syslog, LOG_INFO, {"- loadTables : tables to load: ", to_string(changed.size()), " of ", to_string(toLoad->size())});
+        if(changed.size() == 0) return;
+
+        bool                          split     {false};
+        for(auto &name : changed)
+                if(tableOptions(name).count("split") != 0) split = true;
+
+        if(importSnapshot.size() == 0 && (loaders < 2 || rowStore || (changed.size() < 2 && !split))){
+                for(auto &name : changed)
+                        loadTable(conn, name, db[name]);
+        }else{
+                loadParallel(db, changed);
+        }
+
+        for(auto &version : versions)
+                get<VERS>(db[version.first]) = version.second;
+}
+
+void PsqlConnection::fetchTable(TableName tableName, TableAttr& tableAttr) noexcept(false){
+        PGconn *pconn {getPooled()};
+
+        try{
+                loadTable(pconn, tableName, tableAttr);
+        }catch(...){
+                putPooled(pconn);
+                throw;
+        }
+        putPooled(pconn);
+}
+
+void PsqlConnection::indexTable(TableName tableName, TableAttr& tableAttr) noexcept(false){
+        get<VIDX>(tableAttr).reset();
+
+        // The option index=<column>[,<column>...] of the table: an index for every column,
+        // built on the rows just loaded through their row index.
+        const TableOptions options  = tableOptions(tableName);
+        if(!columnFiles || !rowIndex) return;
+        auto         optionIt    {options.find("index")};
+        if(optionIt == options.end() || !get<DATA>(tableAttr) || 
+           !get<COLS>(tableAttr) || !get<RIDX>(tableAttr)) return;
+
+        const TableStore  &store    {*get<DATA>(tableAttr)};
+        const RowIndex    &index    {*get<RIDX>(tableAttr)};
+        const Columns     &cols     {*get<COLS>(tableAttr)};
+        const char        *data     {store.contiguous()};
+        TableData         copy;
+        if(data == nullptr){
+                copy.resize(store.size());
+                copy.resize(store.read(copy.data(), copy.size(), 0));
+                data = copy.data();
+        }
+
+        auto              indexes   {make_shared<ValueIndexes>()};
+        istringstream     list(optionIt->second);
+        string            column;
+        while(getline(list, column, ',')){
+                size_t c {0};
+                while(c < cols.size() && get<COLNAME>(cols[c]) != column) c++;
+                if(c == cols.size()){
+                        DBFS_LOG(syslog, LOG_WARNING, {"- indexTable : table: ", tableName, " - no column: ", column});
+                        continue;
+                }
+
+                auto  start  {steady_clock::now()};
+                indexes->push_back(ValueIndex(column, c, loadMode == LOAD_COPY && !rowStore));
+                indexes->back().build(data, index);
+                DBFS_LOG(syslog, LOG_NOTICE, {"- indexTable : table: ", tableName, " - column: ", column,
+                                              " - values: ", to_string(indexes->back().values()), 
+                                              " - bytes: ", to_string(indexes->back().memory()), " - ms: ",
+                                              to_string(duration_cast<milliseconds>(steady_clock::now() - start).count())});
+        }
+
+        get<VIDX>(tableAttr) = indexes;
+}
+
+void PsqlConnection::splitRanges(PGconn* pconn, const TableName& tableName, vector<string>& queries) noexcept(false){
+        queries.clear();
+
+        if(rowStore || loaders < 2) return;
+
+        const TableOptions options  = tableOptions(tableName);
+        auto         splitIt     {options.find("split")},
+                     partsIt     {options.find("parts")};
+        if(splitIt == options.end()) return;
+
+        const string selectAll   {"select * from " + tableName + " where "};
+        const char   *params[1]  {tableName.c_str()};
+        long long    parts       {partsIt != options.end() ? atoll(partsIt->second.c_str()) : 
+                                                                     static_cast<long long>(loaders)};
+        PGresult     *result     {nullptr};
+
+        if(parts < 2) return;
+        parts = min(parts, static_cast<long long>(numeric_limits<uint32_t>::max()));
+
+        if(splitIt->second == "ctid"){
+                // Before PostgreSQL 14 a range of ctid is a scan of the whole table: the table is read once.
+                if(PQserverVersion(pconn) < 140000){
+                        DBFS_LOG(syslog, LOG_WARNING, {"- splitRanges : table: ", tableName, 
+                                                       " - split=ctid needs PostgreSQL 14, loading it in one range."});
+                        return;
+                }
+
+                // Ranges of heap blocks: rows added past the last block while loading fall in the last range.
+                result = PQexecParams(pconn, "select pg_relation_size($1::regclass) / current_setting('block_size')::bigint", 
+                                      1, nullptr, params, nullptr, nullptr, 0);
+                if(PQresultStatus(result) != PGRES_TUPLES_OK || PQntuples(result) != 1){
+                        string errBuff {PQerrorMessage(pconn)};
+                        PQclear(result);
+                        throw DbConnExc(string("Split Error: ").append(tableName).append(" : ").append(errBuff));
+                }
+                long long blocks {atoll(PQgetvalue(result, 0, 0))};
+                PQclear(result);
+
+                parts = min(parts, blocks);
+                if(parts < 2) return;
+
+                long long step   {(blocks + parts - 1) / parts};
+                for(long long p = 0; p < parts; p++){
+                        string lower {"ctid >= '(" + to_string(p * step) + ",0)'::tid"},
+                               upper {"ctid < '(" + to_string((p + 1) * step) + ",0)'::tid"};
+                        queries.push_back(selectAll + (p == 0 ? upper : p == parts - 1 ? lower : lower + " and " + upper));
+                }
+        }else{
+                // Ranges of an integer key, of the same width: rows with a null key are loaded with the first range.
+                char   *ident  {PQescapeIdentifier(pconn, splitIt->second.c_str(), splitIt->second.size())};
+                if(ident == nullptr)
+                        throw DbConnExc(string("Split Error: ").append(tableName).append(" : ").append(PQerrorMessage(pconn)));
+                string column  {ident};
+                PQfreemem(ident);
+
+                string bounds  {"select min(" + column + ")::bigint, max(" + column + ")::bigint from " + tableName};
+                result = PQexec(pconn, bounds.c_str());
+                if(PQresultStatus(result) != PGRES_TUPLES_OK || PQntuples(result) != 1){
+                        string errBuff {PQerrorMessage(pconn)};
+                        PQclear(result);
+                        throw DbConnExc(string("Split Error: ").append(tableName).append(" : ").append(errBuff));
+                }
+                if(PQgetisnull(result, 0, 0)){
+                        PQclear(result);
+                        return;
+                }
+                long long          low    {atoll(PQgetvalue(result, 0, 0))},
+                                   high   {atoll(PQgetvalue(result, 0, 1))};
+                PQclear(result);
+
+                unsigned long long span   {static_cast<unsigned long long>(high) - static_cast<unsigned long long>(low)};
+                if(span < static_cast<unsigned long long>(parts)) return;
+
+                // The bound of range p is low + span * p / parts, computed as low + p * (span / parts) + 
+                // p * (span % parts) / parts: no term overflows, with at most 2^32 ranges.
+                unsigned long long quot   {span / parts},
+                                   rem    {span % parts};
+                auto bound = [&](long long p){
+                        unsigned long long up {static_cast<unsigned long long>(p)};
+                        return to_string(static_cast<long long>(static_cast<unsigned long long>(low) + up * quot + up * rem / parts));
+                };
+                for(long long p = 0; p < parts; p++){
+                        string lower {column + " >= " + bound(p)},
+                               upper {column + " < "  + bound(p + 1)};
+                        queries.push_back(selectAll + (p == 0 ? "(" + upper + " or " + column + " is null)" : 
+                                                       p == parts - 1 ? lower : lower + " and " + upper));
+                }
+        }
+
+        DBFS_LOG(syslog, LOG_DEBUG, {"- splitRanges : table: ", tableName, " - split: ", splitIt->second, 
+                                     " - ranges: ", to_string(queries.size())});
+}
+
+void PsqlConnection::sortBySize(const TableNames& names, TableNames& sorted) noexcept(false){
+        const string                      sizeQuery   {"select pg_table_size($1::regclass)"};
+        vector<pair<long long, TableName>> sizes;
+
+        for(auto &name : names){
+                const char *params[1]  {name.c_str()};
+                long long  bytes       {0};
+                PGresult   *result     {PQexecParams(conn, sizeQuery.c_str(), 1, nullptr, params, nullptr, nullptr, 0)};
+
+                if(PQresultStatus(result) == PGRES_TUPLES_OK && PQntuples(result) == 1)
+                        bytes = atoll(PQgetvalue(result, 0, 0));
+                PQclear(result);
+
+                sizes.push_back(make_pair(bytes, name));
+        }
+
+        stable_sort(sizes.begin(), sizes.end(), 
+                    [](const pair<long long, TableName>& a, const pair<long long, TableName>& b){ return a.first > b.first; });
+
+        sorted.clear();
+        for(auto &sz : sizes)
+                sorted.push_back(sz.second);
+}
+
+void PsqlConnection::loadParallel(TableList& db, const TableNames& names) noexcept(false){
+        const string               beginTx    {"begin transaction isolation level repeatable read read only"};
+        TableNames                 sorted;
+        vector<TableAttr*>         attrs;
+        vector<ColumnNames>        colNames;
+        vector<ColumnTypes>        colTypes;
+        vector<LoadJob>            jobs;
+        vector<PGconn*>            workers;
+        vector<thread>             threads;
+        atomic<size_t>             next       {0};
+        atomic<bool>               failed     {false};
+        exception_ptr              error;
+        mutex                      mtxError;
+        string                     snapshot;
+
+        sortBySize(names, sorted);
+        for(auto &name : sorted)
+                attrs.push_back(&db[name]);
+        colNames.resize(sorted.size());
+        colTypes.resize(sorted.size());
+
+        execCmd(conn, beginTx);
+        if(importSnapshot.size() != 0){
+                snapshot = importSnapshot;
+                try{
+                    execCmd(conn, "set transaction snapshot '" + snapshot + "'");
+                }catch(...){
+                    PQclear(PQexec(conn, "rollback"));
+                    throw;
+                }
+        }else{
+                PGresult *result {PQexec(conn, "select pg_export_snapshot()")};
+                if(PQresultStatus(result) != PGRES_TUPLES_OK){
+                        string errBuff {PQerrorMessage(conn)};
+                        PQclear(result);
+                        execCmd(conn, "rollback");
+                        throw DbConnExc(string("Snapshot Error: ").append(errBuff));
+                }
+                snapshot = PQgetvalue(result, 0, 0);
+                PQclear(result);
+        }
+
+        // A job loads a whole table, or a range of a table split in the configuration file:
+        // the ranges are read in the same snapshot and joined, in order, at the end.
+        auto worker = [&](PGconn* pconn){
+                try{
+                    for(size_t j = next++; j < jobs.size() && !failed; j = next++){
+                            LoadJob &job {jobs[j]};
+                            if(get<JQUERY>(job).size() == 0)
+                                    loadTable(pconn, sorted[get<JTABLE>(job)], *attrs[get<JTABLE>(job)]);
+                            else
+                                    get<JROWS>(job) = queryRows(pconn, get<JQUERY>(job), get<JDATA>(job), 
+                                                                columnFiles ? &get<JCOLS>(job) : nullptr,
+                                                                rowIndex ? &get<JINDEX>(job) : nullptr);
+                    }
+                }catch(...){
+                    lock_guard<mutex> lock(mtxError);
+                    if(!error) error = current_exception();
+                    failed = true;
+                }
+        };
+
+        try{
+            for(size_t t = 0; t < sorted.size(); t++){
+                    vector<string> queries;
+                    splitRanges(conn, sorted[t], queries);
+                    if(queries.size() == 0)
+                            jobs.push_back(LoadJob(t, "", TableData(), 0, ColumnData(), RowIndex()));
+                    else if(columnFiles || keepNames || storeEngine == ENGINE_COLUMNAR)
+                            columnNames(conn, sorted[t], colNames[t], colTypes[t]);
+                    for(auto &query : queries)
+                            jobs.push_back(LoadJob(t, query, TableData(), 0, ColumnData(colNames[t].size()), RowIndex()));
+            }
+
+            DBFS_LOG(syslog, LOG_DEBUG, {"- loadParallel : snapshot: ", snapshot, " - connections: ", 
+                                         to_string(min(loaders, jobs.size())), " - tables: ", to_string(sorted.size()),
+                                         " - jobs: ", to_string(jobs.size())});
+
+            for(size_t w = 1; w < min(loaders, jobs.size()); w++){
+                    workers.push_back(getPooled());
+                    execCmd(workers.back(), beginTx);
+                    execCmd(workers.back(), "set transaction snapshot '" + snapshot + "'");
+            }
+        }catch(...){
+            error  = current_exception();
+            failed = true;
+        }
+
+        if(!failed){
+            for(auto pconn : workers)
+                    threads.push_back(thread(worker, pconn));
+            worker(conn);
+            for(auto &th : threads)
+                    th.join();
+        }
+
+        for(auto pconn : workers){
+                PQclear(PQexec(pconn, failed ? "rollback" : "commit"));
+                putPooled(pconn);
+        }
+        PQclear(PQexec(conn, failed ? "rollback" : "commit"));
+
+        if(failed) rethrow_exception(error);
+
+        for(size_t j = 0, last = 0; j < jobs.size(); j = last){
+                size_t     table   {get<JTABLE>(jobs[j])},
+                           total   {0};
+                for(last = j; last < jobs.size() && get<JTABLE>(jobs[last]) == table; last++)
+                        total += get<JDATA>(jobs[last]).size();
+                if(get<JQUERY>(jobs[j]).size() == 0) continue;
+
+                TableData  tdata   {move(get<JDATA>(jobs[j]))};
+                ColumnData cdata   {move(get<JCOLS>(jobs[j]))};
+                auto       index   {make_shared<RowIndex>(move(get<JINDEX>(jobs[j])))};
+                RowNum     rows    {get<JROWS>(jobs[j])};
+
+                tdata.reserve(total);
+                for(size_t r = j + 1; r < last; r++){
+                        index->append(get<JINDEX>(jobs[r]), tdata.size());
+                        get<JINDEX>(jobs[r]) = RowIndex();
+                        tdata.insert(tdata.end(), get<JDATA>(jobs[r]).begin(), get<JDATA>(jobs[r]).end());
+                        TableData().swap(get<JDATA>(jobs[r]));
+                        ColumnData &segment {get<JCOLS>(jobs[r])};
+                        for(size_t c = 0; c < segment.size() && c < cdata.size(); c++)
+                                cdata[c].insert(cdata[c].end(), segment[c].begin(), segment[c].end());
+                        ColumnData().swap(segment);
+                        rows += get<JROWS>(jobs[r]);
+                }
+
+                get<DATA>(*attrs[table]) = makeStore(move(tdata), rows, colTypes[table]);
+                get<COLS>(*attrs[table]) = columnFiles || keepNames ? makeColumns(colNames[table], colTypes[table], move(cdata), rows) : ColumnsPtr();
+                get<RIDX>(*attrs[table]) = rowIndex ? RowIndexPtr(index) : RowIndexPtr();
+                indexTable(sorted[table], *attrs[table]);
+                stampTable(*attrs[table], rows);
+        }
 }
 
 void PsqlConnection::loadDbByOwner(TableList& db, const string owner){
-        syslog->log(LOG_DEBUG, "- loadDbByOwner : Loading Tables.");
+        DBFS_LOG(syslog, LOG_DEBUG, "- loadDbByOwner : Loading Tables.");
 
         int          retRows          {0};
         const string listTables       {"select tablename from pg_tables where tableowner = $1"};
@@ -166,16 +1023,15 @@ void PsqlConnection::loadDbByOwner(TableList& db, const string owner){
              throw DbConnExc("Owner's name param is empty." );
 
         PGresult     *result          {PQexecParams(conn, listTables.c_str(), 1, nullptr, params, lengths, nullptr, 0)};
+        TableNames   names;
 
         switch(PQresultStatus(result)) {
                 case PGRES_TUPLES_OK:
                 case PGRES_COMMAND_OK:
                         retRows   = PQntuples(result);
 
-                        for(int r = 0; r < retRows; r++){
-                                string tableName = PQgetvalue(result, r, 0);
-                                db[tableName];
-                        }
+                        for(int r = 0; r < retRows; r++)
+                                names.push_back(PQgetvalue(result, r, 0));
                 break;
                 case PGRES_EMPTY_QUERY:
                         errBuff = "Empty Query: ";
@@ -188,13 +1044,10 @@ void PsqlConnection::loadDbByOwner(TableList& db, const string owner){
         }
         PQclear(result);
 
-        for(auto &i : db)
-           loadTable(i.first, i.second); 
+        loadTables(db, names, true);
 }
 
-void PsqlConnection::loadDbByList(TableList& db, const string cfile){
-        syslog->log(LOG_DEBUG, "- loadDbByList : Loading Tables.");
-
+void readTableConfig(const string& cfile, TableConfig& config, TableNames& names) noexcept(false){
         if(cfile.size() == 0 ) 
              throw DbConnExc("Config file's name param is empty." );
 
@@ -205,39 +1058,125 @@ void PsqlConnection::loadDbByList(TableList& db, const string cfile){
         if(fileStat.st_size == 0 )
              throw DbConnExc(string("Config file is empty"));
 
-        for(auto &i : db)
-           loadTable(i.first, i.second); 
+        ifstream   ifcfg (cfile.c_str(), ifstream::in);
+        string     line;
+
+        config.clear();
+        names.clear();
+        while(getline(ifcfg, line)){
+            istringstream  fields(line);
+            string         tableName,
+                           option;
+
+            if(!(fields >> tableName) || tableName[0] == '#') continue;
+
+            TableOptions  &options {config[tableName]};
+            if(find(names.begin(), names.end(), tableName) == names.end())
+                names.push_back(tableName);
+
+            while(fields >> option){
+                size_t sep {option.find('=')};
+                if(sep == string::npos || sep == 0)
+                     throw DbConnExc("Invalid option in config file: " + tableName + " " + option);
+                options[option.substr(0, sep)] = option.substr(sep + 1);
+            }
+        }
+}
+
+ColumnsPtr rowColumns(const RowStore& store) noexcept(false){
+        auto         cols     {make_shared<Columns>()};
+        ColumnData   cdata;
+        RowNum       rows     {store.rows()};
 
-        ifstream ifcfg (cfile.c_str(), ifstream::in);
+        store.columnData(cdata);
+        for(size_t c = 0; c < store.names().size() && c < cdata.size(); c++)
+                cols->push_back(Column(store.names()[c], make_shared<FlatStore>(move(cdata[c]), rows),
+                                       c < store.types().size() ? store.types()[c] : 0));
 
-        string tableName;
-        while(getline(ifcfg, tableName)){
-            auto tableIt = db.find(tableName);
-            if(tableIt != db.end())
-                get<DATA>(tableIt->second).clear();
-            else
-                db[tableName]; 
+        return cols;
+}
+
+RowIndexPtr rowOffsets(const RowStore& store) noexcept(false){
+        auto         index    {make_shared<RowIndex>()};
+
+        store.rowIndex(*index);
+        return index;
+}
 
-            loadTable(tableName, db[tableName]); 
+void PsqlConnection::loadDbByList(TableList& db, const string cfile){
+        DBFS_LOG(syslog, LOG_DEBUG, "- loadDbByList : Loading Tables.");
+
+        TableConfig  config;
+        TableNames   names;
+
+        readTableConfig(cfile, config, names);
+        {
+            lock_guard<mutex> lock(mtxConfig);
+            tableConfig = move(config);
         }
+        loadTables(db, names, true);
+}
+
+void PsqlConnection::listen(const string& channel) noexcept(false){
+        char   *ident  {PQescapeIdentifier(conn, channel.c_str(), channel.size())};
+        if(ident == nullptr)
+                throw DbConnExc(string("Listen Error: ").append(PQerrorMessage(conn)));
+
+        string cmdBuff {string("listen ").append(ident)};
+        PQfreemem(ident);
+
+        execCmd(conn, cmdBuff);
+}
+
+bool PsqlConnection::waitNotifies(TableNames& names, int timeoutMs) noexcept(false){
+        PGnotify  *notify    {nullptr};
+        bool      received   {false};
+
+        if(PQconsumeInput(conn) == 0)
+                throw DbConnExc(string("Listen Error: ").append(PQerrorMessage(conn)));
+
+        if((notify = PQnotifies(conn)) == nullptr){
+                struct pollfd  pfd  {PQsocket(conn), POLLIN, 0};
+                if(pfd.fd < 0)
+                        throw DbConnExc("Listen Error: invalid socket.");
+
+                int ret {poll(&pfd, 1, timeoutMs)};
+                if(ret == -1 && errno != EINTR)
+                        throw DbConnExc(string("Listen Error: ").append(strerror(errno)));
+                if(ret <= 0)
+                        return false;
+
+                if(PQconsumeInput(conn) == 0)
+                        throw DbConnExc(string("Listen Error: ").append(PQerrorMessage(conn)));
+                notify = PQnotifies(conn);
+        }
+
+        for( ; notify != nullptr; notify = PQnotifies(conn)){
+                names.push_back(notify->extra);
+                PQfreemem(notify);
+                received = true;
+        }
+
+        return received;
 }
 
 void PsqlConnection::printDebug(const TableList& db) noexcept(true){
      try{
-         for(auto i : db){
-             syslog->log(LOG_DEBUG, { "- postgresql_utils : printDebug :  Table: ",  
-                                      i.first, " - Rows: ",  to_string(get<RNUM>(i.second)), 
-                                      " - Characters: ", to_string(get<DATA>(i.second).size())
-                                    });
-	     const TableData& tdata {get<DATA>(i.second)};
-
-             string buff           {""};
-             for(auto ii : tdata)
-                 buff.push_back(ii);
-             syslog->log(LOG_DEBUG, { "- postgresql_utils : printDebug : ",  buff} );
+         for(auto &i : db){
+	     const StorePtr& store {get<DATA>(i.second)};
+             if(!store) continue;
+
+             DBFS_LOG(syslog, LOG_DEBUG, { "- postgresql_utils : printDebug :  Table: ",  
+                                           i.first, " - Rows: ",  to_string(get<RNUM>(i.second)), 
+                                           " - Characters: ", to_string(store->size())
+                                         });
+
+             string buff           (store->size(), '\0');
+             store->read(&buff[0], buff.size(), 0);
+             DBFS_LOG(syslog, LOG_DEBUG, { "- postgresql_utils : printDebug : ",  buff} );
          }
       }catch(...){
-             syslog->log(LOG_DEBUG, "- postgresql_utils : printDebug : unexpected exception.");
+             DBFS_LOG(syslog, LOG_DEBUG, "- postgresql_utils : printDebug : unexpected exception.");
       }
 }
 
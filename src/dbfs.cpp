@@ -33,39 +33,143 @@ using std::current_exception;
 using std::numeric_limits; 
 using std::atomic;
 using std::mutex;
-using std::condition_variable;
 using std::unique_lock;
 using std::memory_order_relaxed;
+using std::lock_guard;
+using std::thread;
+using std::set;
+using std::dynamic_pointer_cast;
+using std::shared_ptr;
+using std::make_shared;
+using std::move;
+using std::chrono::steady_clock;
+using std::chrono::milliseconds;
 
 using dbfsutils::DbConnExc;
 using dbfsutils::Stat;
 using dbfsutils::SSTAT;
 using dbfsutils::DATA;
 using dbfsutils::RNUM;
+using dbfsutils::VERS;
+using dbfsutils::COLS;
+using dbfsutils::COLNAME;
+using dbfsutils::COLTYPE;
+using dbfsutils::COLSTORE;
+using dbfsutils::ColumnsPtr;
+using dbfsutils::RIDX;
+using dbfsutils::VIDX;
+using dbfsutils::ValueIndexesPtr;
+using dbfsutils::RowNum;
+using dbfsutils::RowIndex;
+using dbfsutils::RangeStore;
+using dbfsutils::StorePtr;
+using dbfsutils::FlatStore;
 using dbfsutils::TableData;
+using dbfsutils::RowIndexPtr;
+using dbfsutils::RowFilter;
+using dbfsutils::TableFormat;
+using dbfsutils::OutFormats;
+using dbfsutils::ColumnNames;
+using dbfsutils::ColumnTypes;
+using dbfsutils::RowStore;
+using dbfsutils::PsqlReplication;
+using dbfsutils::Changes;
+using dbfsutils::CHANGE_INSERT;
+using dbfsutils::CHANGE_UPDATE;
+using dbfsutils::CHANGE_DELETE;
+using dbfsutils::CHANGE_TRUNCATE;
+using dbfsutils::CHANGE_UNKNOWN;
+using dbfsutils::CTABLE;
+using dbfsutils::COP;
+using dbfsutils::COLD;
+using dbfsutils::CNEW;
 using dbfsutils::DBIface;
+using dbfsutils::DbConnection;
+using dbfsutils::TableNames;
+using dbfsutils::TableName;
+using dbfsutils::TableAttr;
+using dbfsutils::Snapshot;
 
 using syslogwrp::Syslog;
 
 namespace dbfs{
 
-    const string        ROOT_DIR                 {"/"}; 
-    const string        PATH_SEPARATOR           {"/"}; 
+    const double        ENTRY_TIMEOUT            {1.0},
+                        ATTR_TIMEOUT             {1.0},
+                        CACHE_TIMEOUT            {86400.0 * 365};
 
     enum                STDCONST                 { STRBUFF_LEN=1024 };
+    enum                NOTIFYCONST              { NOTIFY_POLL_MS=1000, NOTIFY_QUIET_MS=200, 
+                                                   NOTIFY_MAX_MS=2000,  NOTIFY_RETRY_SEC=5 };
+    enum                REPLICACONST             { REPLICA_BATCH=10000 };
+    enum                LAZYCONST                { LAZY_RETRIES=3 };
+    enum                SCHEDCONST               { SCHED_POLL_SEC=1, SCHED_RETRY_SEC=5, SCHED_SNAPSHOT_SEC=300 };
+    enum                INODECONST               { FIRST_INODE=FUSE_ROOT_ID + 1 };
+    enum                DIRCONST                 { DOT_ENTRIES=2 };
+    enum                RESULTCONST              { RESULT_CACHE=16 };
+
+    const char          ALL_FILE[]               {".all"},
+                        ROWS_DIR[]               {".rows"},
+                        HEAD_DIR[]               {".head"},
+                        FILTER_DIR[]             {".filter"},
+                        GREP_DIR[]               {".grep"},
+                        INDEX_PREFIX[]           {"by_"},
+                        PATH_SEP                 {'/'},
+                        EXTENSION_SEP            {'.'},
+                        RANGE_SEP                {'-'},
+                        FILTER_SEP               {'='};
+    // The virtual entries are numbered in the top quarter of the bits of fuse_ino_t, 
+    // 2^48 with 64 bits, 2^24 where fuse_ino_t has 32 bits.
+    static_assert(!numeric_limits<Inode>::is_signed && numeric_limits<Inode>::digits >= 32, "unexpected fuse_ino_t");
+    const Inode         FIRST_VIRTUAL            {Inode(1) << (numeric_limits<Inode>::digits / 4 * 3)};
 
     #ifdef __GNUC__
     #pragma GCC diagnostic push
     #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
     #endif
 
-    atomic<bool>           Dbfs::refreshing(false);
-    atomic<unsigned long>  Dbfs::running(0);
-    mutex                  Dbfs::mtxRefresh;
-    condition_variable     Dbfs::cndRefresh;
+    mutex                  Dbfs::mtxLoad;
+    thread                 Dbfs::listener;
+    thread                 Dbfs::replicator;
+    thread                 Dbfs::scheduler;
+    mutex                  Dbfs::mtxQueue;
+    set<string>            Dbfs::queued;
+    bool                   Dbfs::fullQueued      {false};
+    int                    Dbfs::wakePipe[2]     {-1, -1};
+    atomic<bool>           Dbfs::sigRefresh(false);
+    mutex                  Dbfs::mtxLatches;
+    map<string, shared_ptr<mutex>>  
+                           Dbfs::latches;
+    size_t                 Dbfs::memBudget       {0};
+    atomic<unsigned long>  Dbfs::accessTick(0);
+    unsigned long          Dbfs::evictions       {0};
+    unsigned long          Dbfs::reloads         {0};
+    set<string>            Dbfs::evicted;
+    atomic<bool>           Dbfs::stopping(false);
+    atomic<bool>           Dbfs::snapshotDirty(false);
     Syslog*                Dbfs::syslog          {nullptr};
     Sigaction              Dbfs::saction         {};
-    Filesystem             Dbfs::fsdb;
+    CatalogPtr             Dbfs::fsdb            {std::make_shared<const Catalog>(Filesystem(), Entries(), 
+                                                                          std::make_shared<const Inodes>())};
+    bool                   Dbfs::spliceReads     {false};
+    bool                   Dbfs::kernelCache     {false};
+    bool                   Dbfs::tableDirs       {false};
+    bool                   Dbfs::escapedFields   {false};
+    OutFormats             Dbfs::formats;
+    bool                   Dbfs::formatHeader    {false};
+    mutex                  Dbfs::mtxRendered;
+    map<RenderKey, Rendered>  
+                           Dbfs::rendered;
+    struct fuse_chan*      Dbfs::channel         {nullptr};
+    mutex                  Dbfs::mtxStale;
+    set<Inode>             Dbfs::staleInodes;
+    mutex                  Dbfs::mtxVirtual;
+    map<Inode, Virtual>    Dbfs::virtuals;
+    map<Path, Inode>       Dbfs::virtualInodes;
+    Inode                  Dbfs::nextVirtual     {FIRST_VIRTUAL};
+    mutex                  Dbfs::mtxResults;
+    map<Path, Result>      Dbfs::results;
+    unsigned long          Dbfs::resultTick      {0};
     Dbfs*                  Dbfs::singleDbfs      {nullptr}; 
 
     #ifdef __GNUC__
@@ -77,7 +181,7 @@ namespace dbfs{
               if(exptr) rethrow_exception(exptr);
            }catch(const exception& e) {
               cerr << "- Caught Unexpected Exception : " << e.what() << endl;
-              slog->log(LOG_ERR, {"- Caught Unexpected Exception : ", e.what()});
+              DBFS_LOG(slog, LOG_ERR, {"- Caught Unexpected Exception : ", e.what()});
            }
     }
 
@@ -86,47 +190,1097 @@ namespace dbfs{
          static_cast<void>(ctx);
          static_cast<void>(sig);
 
-         exception_ptr exPtr; 
-         
+         // Only async-signal-safe calls here: the reload is run by scheduleLoop().
+         int  savedErrno {errno};
+         char wake       {'r'};
+
+         Dbfs::sigRefresh.store(true);
+         if(write(Dbfs::wakePipe[1], &wake, 1) == -1) { /* pipe full: a wake up is already pending */ }
+         errno = savedErrno;
+    }
+
+    void Dbfs::requestRefresh(const TableNames& names) noexcept(true){
+         char  wake  {'q'};
+
+         {
+             lock_guard<mutex> lock(Dbfs::mtxQueue);
+             if(names.size() == 0)
+                 Dbfs::fullQueued = true;
+             else
+                 Dbfs::queued.insert(names.begin(), names.end());
+         }
+         if(write(Dbfs::wakePipe[1], &wake, 1) == -1) { /* pipe full: a wake up is already pending */ }
+    }
+
+    void Dbfs::readTtls(map<TableName, time_t>& ttls) noexcept(true){
+         ttls.clear();
+         if(owner.size() != 0) return;
+
          try{
-             Dbfs::refreshing.store(true, memory_order_relaxed); 
-    
-             Dbfs::syslog->log(LOG_DEBUG, "- refreshHdlr : received refresh signal.");
-    
-             Dbfs::syslog->log(LOG_DEBUG, "- refreshHdlr : waiting the end of I/O on the old data.");
-             for(unsigned long int s = Dbfs::running.load(memory_order_relaxed); 
-                 s!=0; s=Dbfs::running.load(memory_order_relaxed)){
-                   Dbfs::syslog->log(LOG_DEBUG, {"- refreshHdlr : I/O threads running: ", to_string(s)});
-                   sleep(1); 
+             dbfsutils::TableConfig  config;
+             TableNames              names;
+
+             dbfsutils::readTableConfig(configurationFile, config, names);
+             for(auto &table : config){
+                 auto ttl = table.second.find("ttl");
+                 if(ttl == table.second.end()) continue;
+
+                 long secs {atol(ttl->second.c_str())};
+                 if(secs > 0) 
+                     ttls[table.first] = secs;
+                 else
+                     DBFS_LOG(Dbfs::syslog, LOG_WARNING, {"- readTtls : invalid ttl for table: ", table.first});
+             }
+         }catch(DbConnExc& ex){
+             DBFS_LOG(Dbfs::syslog, LOG_ERR, {"- readTtls : ", ex.what()});
+         }
+    }
+
+    void Dbfs::scheduleLoop(void) noexcept(true){
+         sigset_t                 sigset;
+         map<TableName, time_t>   ttls,
+                                  due;
+         time_t                   retryAt   {0},
+                                  savedAt   {time(nullptr)};
+
+         sigemptyset(&sigset);
+         sigaddset(&sigset, SIGUSR2);
+         pthread_sigmask(SIG_BLOCK, &sigset, nullptr);
+
+         readTtls(ttls);
+         for(auto &ttl : ttls)
+             due[ttl.first] = time(nullptr) + ttl.second;
+
+         while(!Dbfs::stopping){
+             time_t  now       {time(nullptr)},
+                     next      {now + SCHED_POLL_SEC};
+             for(auto &when : due)
+                 next = std::min(next, when.second);
+
+             struct pollfd  pfd  {Dbfs::wakePipe[0], POLLIN, 0};
+             if(poll(&pfd, 1, next > now ? static_cast<int>(next - now) * 1000 : 0) > 0){
+                 char drain[64];
+                 while(read(Dbfs::wakePipe[0], drain, sizeof(drain)) > 0);
+             }
+             if(Dbfs::sigRefresh.exchange(false))
+                 requestRefresh(TableNames());
+             Dbfs::flushInvalidations();
+
+             now = time(nullptr);
+
+             // The reloads of single tables are written to the snapshot from time to time, out 
+             // of mtxLoad: the whole cache is written each time.
+             if(Dbfs::snapshotDirty && now - savedAt >= SCHED_SNAPSHOT_SEC){
+                 saveSnapshot();
+                 savedAt = now;
+             }
+             if(retryAt > now) continue;
+
+             // Requests pending since the last run are collapsed: a table is loaded once, 
+             // and a full reload supersedes them all.
+             bool        full    {false};
+             set<TableName> batch;
+             {
+                 lock_guard<mutex> lock(Dbfs::mtxQueue);
+                 full             = Dbfs::fullQueued;
+                 Dbfs::fullQueued = false;
+                 if(!full) batch  = Dbfs::queued;
+                 Dbfs::queued.clear();
              }
+             if(!full)
+                 for(auto &when : due)
+                     if(when.second <= now) batch.insert(when.first);
+             if(!full && batch.size() == 0) continue;
+
+             DBFS_LOG(Dbfs::syslog, LOG_INFO, {"- scheduleLoop : refreshing - tables: ", full ? "all" : to_string(batch.size())});
+
+             bool  ok  {false};
+             try{
+                 ok = full ? reloadTables(TableNames()) : reloadTables(TableNames(batch.begin(), batch.end()));
+             }catch(...){
+                 genericExcPtrHdlr(Dbfs::syslog, current_exception());
+             }
+
+             Dbfs::flushInvalidations();
+             now = time(nullptr);
+             if(ok){
+                 retryAt = 0;
+                 if(full){
+                     readTtls(ttls);
+                     due.clear();
+                 }
+                 for(auto &ttl : ttls)
+                     if(full || batch.count(ttl.first) != 0 || due.count(ttl.first) == 0) 
+                         due[ttl.first] = now + ttl.second;
+             }else{
+                 DBFS_LOG(Dbfs::syslog, LOG_WARNING, {"- scheduleLoop : refresh failed, retry in seconds: ", to_string(SCHED_RETRY_SEC)});
+                 retryAt = now + SCHED_RETRY_SEC;
+                 requestRefresh(full ? TableNames() : TableNames(batch.begin(), batch.end()));
+             }
+         }
+    }
+
+    CatalogPtr Dbfs::catalog(void) noexcept(true){
+         return std::atomic_load(&Dbfs::fsdb);
+    }
+
+    FilesystemPtr Dbfs::tables(void) noexcept(true){
+         CatalogPtr cat {Dbfs::catalog()};
+
+         // Shares the ownership of the catalog.
+         return FilesystemPtr(cat, &get<CAT_TABLES>(*cat));
+    }
+
+    void Dbfs::publish(Filesystem&& next, const set<TableName>& touched) noexcept(false){
+         CatalogPtr        prevCat  {Dbfs::catalog()};
+         const Filesystem  &prev    {get<CAT_TABLES>(*prevCat)};
+
+         set<TableName>    reshaped;
+
+         // A reloaded table inherits the recency of the data it replaces. The files of a table
+         // are named after its columns and indexes: they are looked for again only when these change.
+         for(auto &table : next){
+             auto old = prev.find(table.first);
+             if(old == prev.end() || get<COLS>(old->second) != get<COLS>(table.second) || 
+                get<VIDX>(old->second) != get<VIDX>(table.second))
+                 reshaped.insert(table.first);
+
+             const StorePtr &store {get<DATA>(table.second)};
+             if(!store || store->accessed() != 0) continue;
+
+             if(old != prev.end() && get<DATA>(old->second))
+                 store->touch(get<DATA>(old->second)->accessed());
+         }
+
+         InodesPtr  inos  {Dbfs::assignInodes(get<CAT_INODES>(*prevCat), next, reshaped)};
+
+         // The kernel keeps the content of the tables: it must drop what a reload, a lazy load 
+         // or a replicated change has made old. Evicted tables are left in the kernel cache.
+         if(Dbfs::kernelCache){
+             bool               stale    {false};
+             set<TableName>     changed;
+             lock_guard<mutex>  lock(Dbfs::mtxStale);
+
+             for(auto &table : next){
+                 auto old = prev.find(table.first);
+                 if(old == prev.end()){
+                     Dbfs::staleInodes.insert(FUSE_ROOT_ID);
+                     stale = true;
+                     continue;
+                 }
+
+                 const Stat &oldStat {get<SSTAT>(old->second)},
+                            &newStat {get<SSTAT>(table.second)};
+                 size_t     ino      {0};
+                 Nodes      nodes;
+                 // The rows changed in place (-r) keep their store, and maybe their size and time.
+                 if(!get<DATA>(table.second) || (touched.count(table.first) == 0 && get<DATA>(table.second) == get<DATA>(old->second) && 
+                    oldStat.st_size == newStat.st_size && oldStat.st_mtim.tv_sec == newStat.st_mtim.tv_sec &&
+                    oldStat.st_mtim.tv_nsec == newStat.st_mtim.tv_nsec))
+                     continue;
+
+                 Dbfs::tableNodes(table.first, table.second, nodes);
+                 for(auto &node : nodes)
+                     if(get<BYNAME>(*inos).find(get<NPATH>(node), ino)) Dbfs::staleInodes.insert(ino);
+                 changed.insert(table.first);
+                 stale = true;
+             }
+
+             if(changed.size() != 0){
+                 lock_guard<mutex>  lockVirtual(Dbfs::mtxVirtual);
+                 for(auto &file : Dbfs::virtuals){
+                     const Path &path {get<VPATH>(file.second)};
+                     if(changed.count(path.substr(0, path.find(PATH_SEP))) != 0) Dbfs::staleInodes.insert(file.first);
+                 }
+             }
+
+             // Sent by scheduleLoop(): a notification can't be sent from a file system request.
+             char  wake  {'i'};
+             if(stale && write(Dbfs::wakePipe[1], &wake, 1) == -1) { /* pipe full: a wake up is already pending */ }
+         }
+
+         // The entries are indexed by inode once the tables are in their final place: those of 
+         // a table with the same files are pointed to its new place, the others are built again.
+         shared_ptr<Catalog>       cat      {make_shared<Catalog>(move(next), get<CAT_ENTRIES>(*prevCat), inos)};
+         Entries                   &entries {get<CAT_ENTRIES>(*cat)};
+         vector<const TableAttr*>  moved(get<BYINODE>(*inos).size(), nullptr);
+
+         entries.resize(get<BYINODE>(*inos).size(), Entry(nullptr, NODE_TABLE, 0, 0));
+         for(auto &table : get<CAT_TABLES>(*cat)){
+             size_t tableIno {0};
+             if(reshaped.count(table.first) == 0 && get<BYNAME>(*inos).find(table.first, tableIno))
+                 moved[tableIno - FIRST_INODE] = &table.second;
+         }
+         for(auto &entry : entries)
+             if(get<ENTRY_ATTR>(entry) != nullptr) get<ENTRY_ATTR>(entry) = moved[get<ENTRY_TABLE>(entry) - FIRST_INODE];
+
+         for(auto &name : reshaped){
+             auto   table    = get<CAT_TABLES>(*cat).find(name);
+             size_t tableIno {0},
+                    ino      {0};
+             Nodes  nodes;
+             if(!get<BYNAME>(*inos).find(table->first, tableIno)) continue;
+
+             Dbfs::tableNodes(table->first, table->second, nodes);
+             for(auto &node : nodes)
+                 if(get<BYNAME>(*inos).find(get<NPATH>(node), ino)) 
+                     entries[ino - FIRST_INODE] = Entry(&table->second, get<NKIND>(node), get<NCOLUMN>(node), tableIno);
+         }
+
+         // Readers still holding the previous catalog finish on it: it's released with the last of them.
+         std::atomic_store(&Dbfs::fsdb, CatalogPtr(cat));
+         Dbfs::dropRendered(*cat, set<TableName>());
+    }
+
+    void Dbfs::flushInvalidations(void) noexcept(true){
+         set<Inode>  stale;
+         {
+             lock_guard<mutex> lock(Dbfs::mtxStale);
+             stale.swap(Dbfs::staleInodes);
+         }
+         if(Dbfs::channel == nullptr) return;
+
+         for(auto ino : stale){
+             // -ENOENT: the kernel has nothing cached for that inode.
+             int ret {fuse_lowlevel_notify_inval_inode(Dbfs::channel, ino, 0, 0)};
+             if(ret != 0 && ret != -ENOENT)
+                 DBFS_LOG(Dbfs::syslog, LOG_WARNING, {"- flushInvalidations : inode: ", to_string(ino), " - error: ", strerror(-ret)});
+             else
+                 DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- flushInvalidations : inode: ", to_string(ino)});
+         }
+    }
+
+    StorePtr Dbfs::currentStore(Inode ino) noexcept(false){
+         CatalogPtr        cat    {Dbfs::catalog()};
+         Path              path;
+
+         if(ino >= FIRST_VIRTUAL && Dbfs::virtualPath(ino, path)){
+             StorePtr      store;
+             const Entry   *table {nullptr};
+             Dbfs::virtualStore(cat, path, store, table);
+             return store;
+         }
+
+         const Entry       *entry {Dbfs::inodeEntry(cat, ino)};
+
+         return entry != nullptr ? Dbfs::entryStore(*entry) : StorePtr();
+    }
+
+    bool Dbfs::isDir(NODEKIND kind) noexcept(true){
+         return kind == NODE_DIR || kind == NODE_ROWS || kind == NODE_HEAD || 
+                kind == NODE_FILTER || kind == NODE_GREP || kind == NODE_INDEX;
+    }
+
+    bool Dbfs::rowRange(NODEKIND kind, const string& spec, RowNum& first, RowNum& last) noexcept(true){
+         // In .head, <n>: the first n rows. In .rows, <start>-<end>: the rows from start to end, 
+         // numbered from 1. The range is cut to the rows of the table when it's read.
+         const char          *pos  {spec.c_str()};
+         char                *end  {nullptr};
+         unsigned long long  low   {0},
+                             high  {0};
+
+         if(!isdigit(static_cast<unsigned char>(*pos))) return false;
+         errno = 0;
+         low   = strtoull(pos, &end, 10);
+         if(errno != 0) return false;
+
+         if(kind == NODE_HEAD){
+             first = 0;
+             last  = low;
+             return *end == '\0';
+         }
+
+         if(kind != NODE_ROWS || *end != RANGE_SEP || !isdigit(static_cast<unsigned char>(end[1]))) return false;
+         pos   = end + 1;
+         high  = strtoull(pos, &end, 10);
+         if(errno != 0 || *end != '\0' || low == 0 || high < low) return false;
+
+         first = low - 1;
+         last  = high;
+         return true;
+    }
+
+    Inode Dbfs::virtualInode(const Path& path) noexcept(false){
+         lock_guard<mutex> lock(Dbfs::mtxVirtual);
+
+         // Counted like the kernel counts the lookups: the inode is released by the last forget,
+         // its number is never reused.
+         auto  file  = Dbfs::virtualInodes.find(path);
+         if(file != Dbfs::virtualInodes.end()){
+             get<VLOOKUPS>(Dbfs::virtuals[file->second])++;
+             return file->second;
+         }
+
+         Inode ino {Dbfs::nextVirtual++};
+         Dbfs::virtualInodes[path] = ino;
+         Dbfs::virtuals[ino]       = Virtual(path, 1);
+         return ino;
+    }
+
+    bool Dbfs::virtualPath(Inode ino, Path& path) noexcept(false){
+         lock_guard<mutex> lock(Dbfs::mtxVirtual);
+
+         auto  file  = Dbfs::virtuals.find(ino);
+         if(file == Dbfs::virtuals.end()) return false;
+
+         path = get<VPATH>(file->second);
+         return true;
+    }
 
-             Dbfs::syslog->log(LOG_DEBUG, "- refreshHdlr : refreshing.");
-             Dbfs::getInstance()->refreshDb();
+    void Dbfs::forgetVirtual(Inode ino, unsigned long nlookup) noexcept(true){
+         lock_guard<mutex> lock(Dbfs::mtxVirtual);
 
-             Dbfs::syslog->log(LOG_DEBUG, "- refreshHdlr : all data load, sending notification..");
-             unique_lock<mutex> lock(Dbfs::mtxRefresh);
-             Dbfs::cndRefresh.notify_all();
+         auto  file  = Dbfs::virtuals.find(ino);
+         if(file == Dbfs::virtuals.end()) return;
 
-             Dbfs::syslog->log(LOG_DEBUG, "- refreshHdlr : end.");
-             Dbfs::refreshing.store(false, memory_order_relaxed); 
+         if(get<VLOOKUPS>(file->second) > nlookup){
+             get<VLOOKUPS>(file->second) -= nlookup;
+             return;
+         }
+         Dbfs::virtualInodes.erase(get<VPATH>(file->second));
+         Dbfs::virtuals.erase(file);
+    }
+
+    StorePtr Dbfs::formatStore(const Entry& entry, bool render) noexcept(false){
+         const TableAttr   &attr    {*get<ENTRY_ATTR>(entry)};
+         const StorePtr    &data    {get<DATA>(attr)};
+         const ColumnsPtr  &cols    {get<COLS>(attr)};
+         RenderKey         key      {get<ENTRY_TABLE>(entry), get<ENTRY_COLUMN>(entry)};
+
+         if(!data || !cols || get<ENTRY_COLUMN>(entry) >= Dbfs::formats.size()) return StorePtr();
+
+         // A format is rendered at its first access and kept until the table is reloaded or changed.
+         {
+             lock_guard<mutex> lock(Dbfs::mtxRendered);
+             auto  cached  = Dbfs::rendered.find(key);
+             if(cached != Dbfs::rendered.end() && get<REN_SOURCE>(cached->second).lock() == data)
+                 return get<REN_STORE>(cached->second);
+         }
+         if(!render) return StorePtr();
+
+         ColumnNames       names;
+         ColumnTypes       types;
+         for(auto &col : *cols){
+             names.push_back(get<COLNAME>(col));
+             types.push_back(get<COLTYPE>(col));
+         }
+
+         const char        *bytes   {data->contiguous()};
+         TableData         copy;
+         size_t            len      {data->size()};
+         if(bytes == nullptr){
+             copy.resize(len);
+             len   = data->read(copy.data(), copy.size(), 0);
+             bytes = copy.data();
+         }
+
+         TableFormat       format   {Dbfs::formats[get<ENTRY_COLUMN>(entry)], names,
+                                     Dbfs::escapedFields && dynamic_cast<const RowStore*>(data.get()) == nullptr,
+                                     Dbfs::formatHeader, types};
+         TableData         out;
+         RowNum            rows     {format.render(bytes, len, out)};
+         StorePtr          store    {make_shared<FlatStore>(move(out), rows)};
+
+         DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- formatStore : table inode: ", to_string(get<ENTRY_TABLE>(entry)), 
+                                            " - format: ", TableFormat::extension(Dbfs::formats[get<ENTRY_COLUMN>(entry)]),
+                                            " - bytes: ", to_string(store->size())});
+
+         lock_guard<mutex> lock(Dbfs::mtxRendered);
+         Dbfs::rendered[key] = Rendered(data, store);
+         return store;
+    }
+
+    void Dbfs::dropRendered(const Catalog& cat, const set<TableName>& changed) noexcept(true){
+         lock_guard<mutex> lock(Dbfs::mtxRendered);
+
+         // Dropped when the table has other rows, or when they were changed in place.
+         for(auto file = Dbfs::rendered.begin(); file != Dbfs::rendered.end(); ){
+             Inode           tableIno  {get<RKEY_TABLE>(file->first)};
+             const Filename  &name     {get<BYINODE>(*get<CAT_INODES>(cat))[tableIno - FIRST_INODE]};
+             auto            table     = get<CAT_TABLES>(cat).find(name);
+             if(table == get<CAT_TABLES>(cat).end() || changed.count(name) != 0 ||
+                get<DATA>(table->second) != get<REN_SOURCE>(file->second).lock())
+                 file = Dbfs::rendered.erase(file);
+             else
+                 ++file;
+         }
+    }
+
+    bool Dbfs::findResult(const Path& path, const RowIndexPtr& index, StorePtr& store) noexcept(false){
+         lock_guard<mutex> lock(Dbfs::mtxResults);
+         auto  cached  = Dbfs::results.find(path);
+         if(cached == Dbfs::results.end() || get<RES_INDEX>(cached->second).lock() != index) return false;
+
+         get<RES_TICK>(cached->second) = ++Dbfs::resultTick;
+         store = get<RES_STORE>(cached->second);
+         return true;
+    }
+
+    void Dbfs::keepResult(const Path& path, const RowIndexPtr& index, const StorePtr& store) noexcept(false){
+         lock_guard<mutex> lock(Dbfs::mtxResults);
+         if(Dbfs::results.size() >= RESULT_CACHE && Dbfs::results.find(path) == Dbfs::results.end()){
+             auto  oldest  = Dbfs::results.begin();
+             for(auto res = Dbfs::results.begin(); res != Dbfs::results.end(); ++res)
+                 if(get<RES_TICK>(res->second) < get<RES_TICK>(oldest->second)) oldest = res;
+             Dbfs::results.erase(oldest);
+         }
+         Dbfs::results[path] = Result(index, store, ++Dbfs::resultTick);
+    }
+
+    int Dbfs::filterStore(const Path& path, const Entry& dir, const string& spec, StorePtr& store) noexcept(false){
+         const TableAttr   &attr    {*get<ENTRY_ATTR>(dir)};
+         const RowIndexPtr &index   {get<RIDX>(attr)};
+
+         // The rows selected are kept for the last paths looked up, until the table changes:
+         // the lookup, the attributes and the open of a file scan the table once.
+         if(Dbfs::findResult(path, index, store)) return 0;
+
+         RowFilter::FILTERMODE  mode     {RowFilter::FILTER_TEXT};
+         string                 pattern  {spec};
+         size_t                 column   {0};
+         if(get<ENTRY_KIND>(dir) == NODE_FILTER){
+             const ColumnsPtr &cols {get<COLS>(attr)};
+             size_t           sep   {spec.find(FILTER_SEP)};
+             if(sep == string::npos || !cols) return -ENOENT;
+             while(column < cols->size() && get<COLNAME>((*cols)[column]) != spec.substr(0, sep)) column++;
+             if(column == cols->size()) return -ENOENT;
+             mode    = RowFilter::FILTER_FIELD;
+             pattern = spec.substr(sep + 1);
+         }
+
+         // A store not held in a single buffer is read in a copy first. The fields of a table 
+         // loaded with COPY are escaped, except the ones kept in rows for the replication.
+         const StorePtr    &data    {get<DATA>(attr)};
+         const char        *bytes   {data->contiguous()};
+         TableData         copy;
+         if(bytes == nullptr){
+             copy.resize(index->start(index->rows()));
+             data->read(copy.data(), copy.size(), 0);
+             bytes = copy.data();
+         }
+
+         RowFilter         filter   {mode, pattern, column, 
+                                     Dbfs::escapedFields && dynamic_cast<const RowStore*>(data.get()) == nullptr};
+         TableData         selected;
+         RowNum            rows     {filter.select(bytes, *index, selected)};
+         store = make_shared<FlatStore>(move(selected), rows);
+         Dbfs::keepResult(path, index, store);
+
+         return 0;
+    }
+
+    int Dbfs::virtualStore(const CatalogPtr& cat, const Path& path, StorePtr& store, const Entry*& table) noexcept(false){
+         size_t            sep    {path.rfind(PATH_SEP)},
+                           ino    {0};
+         RowNum            first  {0},
+                           last   {0};
+
+         store.reset();
+         table = nullptr;
+         if(sep == string::npos || !get<BYNAME>(*get<CAT_INODES>(*cat)).find(path.substr(0, sep), ino)) return -ENOENT;
+
+         const Entry       *dir   {Dbfs::inodeEntry(cat, ino)};
+         if(dir == nullptr) return -ENOENT;
+
+         const string      spec   {path.substr(sep + 1)};
+         bool              filter {get<ENTRY_KIND>(*dir) == NODE_FILTER || get<ENTRY_KIND>(*dir) == NODE_GREP};
+         if(!filter && get<ENTRY_KIND>(*dir) != NODE_INDEX && !Dbfs::rowRange(get<ENTRY_KIND>(*dir), spec, first, last)) return -ENOENT;
+
+         // The entry of the directory carries the table, for its load and its attributes.
+         table = dir;
+         const TableAttr   &attr  {*get<ENTRY_ATTR>(*dir)};
+         if(!get<DATA>(attr)) return -EAGAIN;
+         if(!get<RIDX>(attr)) return -ENOENT;
+         if(filter) return Dbfs::filterStore(path, *dir, spec, store);
+
+         if(get<ENTRY_KIND>(*dir) == NODE_INDEX){
+             // A value without rows has no file. The rows found are kept like the ones of a filter:
+             // the lookup, the attributes, the open and the reads don't search them again.
+             const ValueIndexesPtr &indexes {get<VIDX>(attr)};
+             TableData             selected;
+             if(Dbfs::findResult(path, get<RIDX>(attr), store)) return 0;
+             if(!indexes || get<ENTRY_COLUMN>(*dir) >= indexes->size()) return -ENOENT;
+             RowNum                rows  {(*indexes)[get<ENTRY_COLUMN>(*dir)].find(*get<DATA>(attr), *get<RIDX>(attr), 
+                                                                                    spec, selected)};
+             if(rows == 0) return -ENOENT;
+             store = make_shared<FlatStore>(move(selected), rows);
+             Dbfs::keepResult(path, get<RIDX>(attr), store);
+             return 0;
+         }
+
+         const RowIndex    &index {*get<RIDX>(attr)};
+         last   = std::min(last, index.rows());
+         first  = std::min(first, last);
+
+         size_t            begin  {index.start(first)};
+         store  = make_shared<RangeStore>(get<DATA>(attr), begin, index.start(last) - begin, last - first);
+         return 0;
+    }
+
+    int Dbfs::openVirtual(const Path& path, CatalogPtr& cat, StorePtr& store, const Entry*& table, bool& loaded) noexcept(true){
+         loaded = false;
+
+         try{
+             for(int retry = 0; ; retry++){
+                 cat = Dbfs::catalog();
+
+                 int ret {Dbfs::virtualStore(cat, path, store, table)};
+                 if(ret != -EAGAIN) return ret;
+                 if(retry == LAZY_RETRIES) return -EIO;
+
+                 ret = Dbfs::loadLazy(*Dbfs::inodeName(cat, get<ENTRY_TABLE>(*table)), loaded);
+                 if(ret != 0) return ret;
+             }
          }catch(...){
-             exPtr = current_exception();
-	     genericExcPtrHdlr(Dbfs::syslog, exPtr);
+             genericExcPtrHdlr(Dbfs::syslog, current_exception());
          }
+
+         return -EIO;
+    }
+
+    Stat Dbfs::virtualStat(const Entry& table, const StorePtr& store, Inode ino) noexcept(true){
+         Stat              stbuf  {get<SSTAT>(*get<ENTRY_ATTR>(table))};
+
+         stbuf.st_size = store ? store->size() : 0;
+         stbuf.st_ino  = ino;
+
+         return stbuf;
+    }
+
+    void Dbfs::tableNodes(const TableName& table, const TableAttr& attr, Nodes& nodes) noexcept(false){
+         nodes.clear();
+         nodes.push_back(Node(table, Dbfs::tableDirs ? NODE_DIR : NODE_TABLE, 0));
+         for(size_t f = 0; f < Dbfs::formats.size(); f++)
+             nodes.push_back(Node(table + EXTENSION_SEP + TableFormat::extension(Dbfs::formats[f]), NODE_FORMAT, f));
+         if(!Dbfs::tableDirs) return;
+
+         nodes.push_back(Node(table + PATH_SEP + ALL_FILE, NODE_ALL, 0));
+         nodes.push_back(Node(table + PATH_SEP + ROWS_DIR, NODE_ROWS, 0));
+         nodes.push_back(Node(table + PATH_SEP + HEAD_DIR, NODE_HEAD, 0));
+         nodes.push_back(Node(table + PATH_SEP + FILTER_DIR, NODE_FILTER, 0));
+         nodes.push_back(Node(table + PATH_SEP + GREP_DIR, NODE_GREP, 0));
+
+         // Names that can't be a file, or that could hide the files of dbfs, are skipped.
+         const ColumnsPtr &cols {get<COLS>(attr)};
+         for(size_t c = 0; cols && c < cols->size(); c++){
+             const string &name {get<COLNAME>((*cols)[c])};
+             if(name.size() == 0 || name[0] == '.' || name.find(PATH_SEP) != string::npos) continue;
+             nodes.push_back(Node(table + PATH_SEP + name, NODE_COLUMN, c));
+         }
+
+         const ValueIndexesPtr &indexes {get<VIDX>(attr)};
+         for(size_t i = 0; indexes && i < indexes->size(); i++){
+             const string &name {(*indexes)[i].name()};
+             if(name.find(PATH_SEP) != string::npos) continue;
+             nodes.push_back(Node(table + PATH_SEP + INDEX_PREFIX + name, NODE_INDEX, i));
+         }
+    }
+
+    StorePtr Dbfs::entryStore(const Entry& entry) noexcept(true){
+         const TableAttr   &attr  {*get<ENTRY_ATTR>(entry)};
+
+         switch(get<ENTRY_KIND>(entry)){
+             case NODE_COLUMN:
+             {
+                  const ColumnsPtr &cols {get<COLS>(attr)};
+                  if(!cols || get<ENTRY_COLUMN>(entry) >= cols->size()) return StorePtr();
+                  return get<COLSTORE>((*cols)[get<ENTRY_COLUMN>(entry)]);
+             }
+             case NODE_FORMAT:
+                  try{
+                      return Dbfs::formatStore(entry);
+                  }catch(...){
+                      genericExcPtrHdlr(Dbfs::syslog, current_exception());
+                  }
+                  return StorePtr();
+             case NODE_DIR:
+             case NODE_ROWS:
+             case NODE_HEAD:
+             case NODE_FILTER:
+             case NODE_GREP:
+             case NODE_INDEX:
+                  return StorePtr();
+             case NODE_TABLE:
+             case NODE_ALL:
+             default:
+                  return get<DATA>(attr);
+         }
+    }
+
+    Stat Dbfs::entryStat(const Entry& entry, Inode ino) noexcept(true){
+         Stat              stbuf  {get<SSTAT>(*get<ENTRY_ATTR>(entry))};
+
+         // A directory and its files share the times of the table.
+         if(Dbfs::isDir(get<ENTRY_KIND>(entry))){
+             stbuf.st_mode  = S_IFDIR | 0555;
+             stbuf.st_nlink = 2;
+             stbuf.st_size  = 0;
+         }else if(get<ENTRY_KIND>(entry) == NODE_COLUMN){
+             StorePtr store {Dbfs::entryStore(entry)};
+             stbuf.st_size  = store ? store->size() : 0;
+         }else if(get<ENTRY_KIND>(entry) == NODE_FORMAT){
+             // A format is rendered by its opening, not to know its size: until then it's 0,
+             // and the file is read with direct_io.
+             StorePtr store;
+             try{
+                 store = Dbfs::formatStore(entry, false);
+             }catch(...){
+                 genericExcPtrHdlr(Dbfs::syslog, current_exception());
+             }
+             stbuf.st_size  = store ? store->size() : 0;
+         }
+         stbuf.st_ino = ino;
+
+         return stbuf;
+    }
+
+    size_t Dbfs::tableMemory(const TableAttr& attr, const RenderedBytes& rendered) noexcept(true){
+         size_t            bytes  {get<DATA>(attr) ? get<DATA>(attr)->memory() : 0};
+         const ColumnsPtr  &cols  {get<COLS>(attr)};
+         auto              formats = rendered.find(get<DATA>(attr).get());
+
+         if(formats != rendered.end()) bytes += formats->second;
+         for(size_t c = 0; cols && c < cols->size(); c++)
+             bytes += get<COLSTORE>((*cols)[c]) ? get<COLSTORE>((*cols)[c])->memory() : 0;
+         if(get<RIDX>(attr)) bytes += get<RIDX>(attr)->memory();
+         for(size_t i = 0; get<VIDX>(attr) && i < get<VIDX>(attr)->size(); i++)
+             bytes += (*get<VIDX>(attr))[i].memory();
+
+         return bytes;
+    }
+
+    InodesPtr Dbfs::assignInodes(const InodesPtr& prev, const Filesystem& next, const set<TableName>& tables) noexcept(false){
+         shared_ptr<Inodes>  added;
+         size_t              ino    {0};
+         Nodes               nodes;
+
+         // Tables are never dropped from the file system: an inode names the same table, 
+         // or the same file of a table directory, for the whole life of the mount and its 
+         // number is never reused. A dropped column keeps its inode, without an entry.
+         // Only the tables given can have new files.
+         for(auto &name : tables){
+             auto table = next.find(name);
+             if(table == next.end()) continue;
+
+             Dbfs::tableNodes(table->first, table->second, nodes);
+             for(auto &node : nodes){
+                 const Path &path {get<NPATH>(node)};
+                 if(get<BYNAME>(added ? *added : *prev).find(path, ino)) continue;
+                 if(!added) added = make_shared<Inodes>(*prev);
+
+                 get<BYNAME>(*added).insert(path.data(), path.size(), FIRST_INODE + get<BYINODE>(*added).size());
+                 get<BYINODE>(*added).push_back(path);
+             }
+         }
+
+         return added ? InodesPtr(added) : prev;
     }
 
-    int Dbfs::getattrCb(const char *path, Stat *stbuf) noexcept(true){
-      Dbfs::syslog->log(LOG_DEBUG, {"- getattrCb : FullPath:", path});
+    const Filename* Dbfs::inodeName(const CatalogPtr& cat, Inode ino) noexcept(true){
+         const Inodes &inos {*get<CAT_INODES>(*cat)};
+         if(ino < FIRST_INODE || ino - FIRST_INODE >= get<BYINODE>(inos).size()) return nullptr;
+
+         return &get<BYINODE>(inos)[ino - FIRST_INODE];
+    }
+
+    const Entry* Dbfs::inodeEntry(const CatalogPtr& cat, Inode ino) noexcept(true){
+         const Entries &entries {get<CAT_ENTRIES>(*cat)};
+         if(ino < FIRST_INODE || ino - FIRST_INODE >= entries.size() || 
+            get<ENTRY_ATTR>(entries[ino - FIRST_INODE]) == nullptr) return nullptr;
+
+         return &entries[ino - FIRST_INODE];
+    }
+
+    bool Dbfs::reloadTables(const TableNames& names, const string& snapshot) noexcept(false){
+         lock_guard<mutex> loadLock(Dbfs::mtxLoad);
+         bool              ret      {true};
+
+         DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- reloadTables : refreshing - tables: ", names.size() == 0 ? "all" : to_string(names.size())});
+         if(names.size() == 0){
+             ret = refreshDb();
+         }else{
+             try{
+                 Filesystem next {*Dbfs::tables()};
+
+                 dbconn->setSnapshot(snapshot);
+                 dbconn->loadTables(next, names);
+                 Dbfs::enforceBudget(next, "");
+                 Dbfs::publish(move(next));
+                 Dbfs::snapshotDirty.store(true);
+             }catch(DbConnExc& ex){
+                 DBFS_LOG(Dbfs::syslog, LOG_ERR, {"- reloadTables: psql exception:", ex.what()});
+                 ret  =  false;
+             }
+             dbconn->setSnapshot("");
+         }
+
+         DBFS_LOG(Dbfs::syslog, LOG_DEBUG, "- reloadTables : new tables published.");
+
+         return ret;
+    }
+
+    void Dbfs::listenLoop(void) noexcept(true){
+         sigset_t  sigset;
+         sigemptyset(&sigset);
+         sigaddset(&sigset, SIGUSR2);
+         pthread_sigmask(SIG_BLOCK, &sigset, nullptr);
+
+         while(!Dbfs::stopping){
+             try{
+                 std::unique_ptr<DbConnection> lconn {DBIface::getInstance().getDbConn("postgresql", Dbfs::syslog)};
+                 lconn->connect(dbName, userName, dbAddress, dbPort, dbPwd);
+                 lconn->listen(notifyChannel);
+                 DBFS_LOG(Dbfs::syslog, LOG_INFO, {"- listenLoop : listening on channel: ", notifyChannel});
+
+                 while(!Dbfs::stopping){
+                     TableNames  payloads;
+                     if(!lconn->waitNotifies(payloads, NOTIFY_POLL_MS)) continue;
+
+                     // Coalesce a burst: keep collecting until the channel stays quiet 
+                     // for NOTIFY_QUIET_MS, or NOTIFY_MAX_MS have passed since the first one.
+                     auto start = steady_clock::now();
+                     while(steady_clock::now() - start < milliseconds(NOTIFY_MAX_MS) && 
+                           lconn->waitNotifies(payloads, NOTIFY_QUIET_MS));
+
+                     bool           all     {false};
+                     set<TableName> unique;
+                     FilesystemPtr  fs      {Dbfs::tables()};
+                     for(auto &payload : payloads){
+                         if(payload.size() == 0 || payload == "*"){
+                             all = true;
+                         }else if(fs->find(payload) != fs->end()){
+                             unique.insert(payload);
+                         }else{
+                             DBFS_LOG(Dbfs::syslog, LOG_WARNING, {"- listenLoop : notification for a table not in cache: ", payload});
+                         }
+                     }
+
+                     DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- listenLoop : notifications: ", to_string(payloads.size()), 
+                                                        " - tables: ", all ? "all" : to_string(unique.size())});
+                     if(all)
+                         requestRefresh(TableNames());
+                     else if(unique.size() != 0)
+                         requestRefresh(TableNames(unique.begin(), unique.end()));
+                 }
+             }catch(DbConnExc& ex){
+                 DBFS_LOG(Dbfs::syslog, LOG_ERR, {"- listenLoop : psql exception: ", ex.what()});
+                 for(int s = 0; s < NOTIFY_RETRY_SEC && !Dbfs::stopping; s++)
+                     sleep(1);
+             }catch(...){
+                 genericExcPtrHdlr(Dbfs::syslog, current_exception());
+                 for(int s = 0; s < NOTIFY_RETRY_SEC && !Dbfs::stopping; s++)
+                     sleep(1);
+             }
+         }
+    }
+
+    void Dbfs::applyChanges(Changes& changes, set<TableName>& reload) noexcept(false){
+         set<TableName>          touched;
+         unique_lock<mutex>      loadLock(Dbfs::mtxLoad);
+         FilesystemPtr           fs        {Dbfs::tables()};
+         map<string, TableName>  replicated;
+
+         for(auto &table : *fs){
+             shared_ptr<RowStore> store {dynamic_pointer_cast<RowStore>(get<DATA>(table.second))};
+             if(store) replicated[store->qualified()] = table.first;
+         }
+
+         for(auto &change : changes){
+             auto name = replicated.find(get<CTABLE>(change));
+             if(name == replicated.end() || reload.count(name->second) != 0) continue;
+
+             RowStore* store   {static_cast<RowStore*>(get<DATA>(fs->at(name->second)).get())};
+             bool      applied {false};
+
+             switch(get<COP>(change)){
+                 case CHANGE_INSERT:
+                      applied = store->put(get<CNEW>(change), nullptr);
+                 break;
+                 case CHANGE_UPDATE:
+                      applied = !store->keyless() && store->put(get<CNEW>(change), &get<COLD>(change));
+                 break;
+                 case CHANGE_DELETE:
+                      applied = !store->keyless() && store->erase(get<COLD>(change));
+                 break;
+                 case CHANGE_TRUNCATE:
+                      store->clear();
+                      applied = true;
+                 break;
+                 case CHANGE_UNKNOWN:
+                 default:
+                 break;
+             }
+
+             if(applied){
+                 touched.insert(name->second);
+             }else{
+                 DBFS_LOG(Dbfs::syslog, LOG_INFO, {"- applyChanges : change not applicable, reloading: ", name->second});
+                 reload.insert(name->second);
+             }
+         }
+
+         // The rows are changed in place: a new set is published only for the new sizes and times.
+         if(touched.size() != 0){
+             Filesystem next {*fs};
+             time_t     now  {time(nullptr)};
+             for(auto &name : touched){
+                 auto &attr  = next[name];
+                 Stat &fstat = get<SSTAT>(attr);
+                 get<RNUM>(attr)  = get<DATA>(attr)->rows();
+                 fstat.st_size    = get<DATA>(attr)->size();
+                 fstat.st_mtime   = fstat.st_ctime = now;
+                 if(Dbfs::tableDirs){
+                     const RowStore &rows {*static_cast<RowStore*>(get<DATA>(attr).get())};
+                     get<COLS>(attr) = dbfsutils::rowColumns(rows);
+                     get<RIDX>(attr) = dbfsutils::rowOffsets(rows);
+                     dbconn->indexTable(name, attr);
+                 }
+             }
+             Dbfs::publish(move(next), touched);
+             Dbfs::dropRendered(*Dbfs::catalog(), touched);
+         }
+         loadLock.unlock();
+
+         DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- applyChanges : changes: ", to_string(changes.size()), 
+                                            " - tables: ", to_string(touched.size()), " - reloads: ", to_string(reload.size())});
+    }
+
+    void Dbfs::replicaLoop(void) noexcept(true){
+         sigset_t  sigset;
+         sigemptyset(&sigset);
+         sigaddset(&sigset, SIGUSR2);
+         pthread_sigmask(SIG_BLOCK, &sigset, nullptr);
+
+         bool      resync   {false};
+
+         while(!Dbfs::stopping){
+             try{
+                 if(resync){
+                     // The changes between the old and the new slot are lost: 
+                     // reload every cached table from the snapshot of the new slot. 
+                     replica->connect(dbName, userName, dbAddress, dbPort, dbPwd);
+                     string     snapshot  {replica->createSlot()};
+                     TableNames names;
+
+                     for(auto &table : *Dbfs::tables())
+                         names.push_back(table.first);
+
+                     if(!reloadTables(names, snapshot))
+                         throw DbConnExc("Replication Error: resync failed.");
+                     resync = false;
+                 }
+
+                 replica->start();
+                 DBFS_LOG(Dbfs::syslog, LOG_INFO, "- replicaLoop : replication started.");
+
+                 // A table with changes not applicable is reloaded by scheduleLoop(): until its new
+                 // rows are published, the position confirmed stays before its first change skipped.
+                 Reloads   waiting;
+
+                 while(!Dbfs::stopping){
+                     Changes         changes;
+                     set<TableName>  reload;
+                     uint64_t        before   {replica->committed()};
+
+                     if(replica->receive(changes, NOTIFY_POLL_MS)){
+                         while(changes.size() < REPLICA_BATCH && replica->receive(changes, 0));
+                         applyChanges(changes, reload);
+                     }else if(waiting.size() == 0){
+                         continue;
+                     }
+
+                     FilesystemPtr  fs      {Dbfs::tables()};
+                     for(auto &name : reload){
+                         if(waiting.count(name) != 0) continue;
+                         auto table = fs->find(name);
+                         waiting[name] = Reload(table != fs->end() ? get<DATA>(table->second) : StorePtr(), before);
+                     }
+                     if(reload.size() != 0)
+                         requestRefresh(TableNames(reload.begin(), reload.end()));
+
+                     uint64_t       upTo    {replica->committed()};
+                     for(auto wait = waiting.begin(); wait != waiting.end(); ){
+                         auto table = fs->find(wait->first);
+                         if(table == fs->end() || get<DATA>(table->second) != get<RLD_SOURCE>(wait->second).lock()){
+                             wait = waiting.erase(wait);
+                             continue;
+                         }
+                         upTo = std::min(upTo, get<RLD_LSN>(wait->second));
+                         ++wait;
+                     }
+                     replica->confirm(upTo);
+                 }
+             }catch(DbConnExc& ex){
+                 DBFS_LOG(Dbfs::syslog, LOG_ERR, {"- replicaLoop : psql exception: ", ex.what()});
+                 replica->close();
+                 resync = true;
+                 for(int s = 0; s < NOTIFY_RETRY_SEC && !Dbfs::stopping; s++)
+                     sleep(1);
+             }catch(...){
+                 genericExcPtrHdlr(Dbfs::syslog, current_exception());
+                 replica->close();
+                 resync = true;
+                 for(int s = 0; s < NOTIFY_RETRY_SEC && !Dbfs::stopping; s++)
+                     sleep(1);
+             }
+         }
+
+         replica->close();
+    }
+
+    void Dbfs::saveSnapshot(void) noexcept(true){
+         if(snapshotFile.size() == 0 || replication) return;
+
+         Dbfs::snapshotDirty.store(false);
+         try{
+             Snapshot::save(snapshotFile, *Dbfs::tables(), Dbfs::syslog);
+         }catch(...){
+             genericExcPtrHdlr(Dbfs::syslog, current_exception());
+         }
+    }
+
+    void Dbfs::initCb(void *data, ConnInfo *conn) noexcept(true){
+         static_cast<void>(data);
+
+         // Started after the daemon fork: from now on the callbacks don't wait for syslog(3).
+         try{
+             Dbfs::syslog->startAsync();
+         }catch(...){
+             genericExcPtrHdlr(Dbfs::syslog, current_exception());
+         }
+
+         DBFS_LOG(Dbfs::syslog, LOG_DEBUG, "- initCb.");
+
+         if((conn->capable & FUSE_CAP_SPLICE_WRITE) != 0){
+             conn->want        |= FUSE_CAP_SPLICE_WRITE | (conn->capable & FUSE_CAP_SPLICE_MOVE);
+             Dbfs::spliceReads  = true;
+         }
+
+         Dbfs* dbfs {Dbfs::getInstance()};
+         if(dbfs->notifyChannel.size() != 0)
+             Dbfs::listener = thread(&Dbfs::listenLoop, dbfs);
+         if(dbfs->replica)
+             Dbfs::replicator = thread(&Dbfs::replicaLoop, dbfs);
+
+         // Served from the snapshot until now: reload from the db what changed meanwhile.
+         if(dbfs->warmStart)
+             dbfs->requestRefresh(TableNames());
+         Dbfs::scheduler = thread(&Dbfs::scheduleLoop, dbfs);
+    }
+
+    void Dbfs::destroyCb(void *data) noexcept(true){
+         static_cast<void>(data);
+
+         DBFS_LOG(Dbfs::syslog, LOG_DEBUG, "- destroyCb.");
+
+         Dbfs::stopping.store(true);
+         if(Dbfs::listener.joinable())
+             Dbfs::listener.join();
+         if(Dbfs::replicator.joinable())
+             Dbfs::replicator.join();
+         if(Dbfs::scheduler.joinable())
+             Dbfs::scheduler.join();
+
+         if(Dbfs::memBudget != 0)
+             DBFS_LOG(Dbfs::syslog, LOG_NOTICE, {"- destroyCb : memory budget: ", to_string(Dbfs::memBudget), 
+                                                 " - evictions: ", to_string(Dbfs::evictions), " - reloads: ", to_string(Dbfs::reloads)});
+
+         Dbfs::syslog->stopAsync();
+    }
+
+    void Dbfs::lookupCb(Request req, Inode parent, const char *name) noexcept(true){
+      DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- lookupCb : name: ", name});
 
       exception_ptr exPtr; 
-      int    res             {0};
-      bool   refr            {Dbfs::refreshing.load(memory_order_relaxed)};
 
-      unique_lock<mutex> lock(Dbfs::mtxRefresh);
-      while(refr)
-         Dbfs::cndRefresh.wait(lock);
+      try{
+         CatalogPtr        cat    {Dbfs::catalog()};
+         size_t            ino    {0};
+         Path              path;
+         const Entry       *dir   {parent == FUSE_ROOT_ID ? nullptr : Dbfs::inodeEntry(cat, parent)};
+
+         Stat              stbuf;
+
+         if(parent != FUSE_ROOT_ID){
+             if(dir == nullptr || !Dbfs::isDir(get<ENTRY_KIND>(*dir))){
+                 fuse_reply_err(req, dir == nullptr ? ENOENT : ENOTDIR);
+                 return;
+             }
+             path = *Dbfs::inodeName(cat, parent) + PATH_SEP + name;
+         }
+
+         if(dir != nullptr && get<ENTRY_KIND>(*dir) != NODE_DIR){
+             // A virtual file exists from its lookup: the table is loaded, if needed, to know its size.
+             StorePtr        store;
+             const Entry     *table  {nullptr};
+             bool            loaded  {false};
+             int             ret     {Dbfs::openVirtual(path, cat, store, table, loaded)};
+             if(ret != 0){
+                 fuse_reply_err(req, -ret);
+                 return;
+             }
+             ino   = Dbfs::virtualInode(path);
+             stbuf = Dbfs::virtualStat(*table, store, ino);
+         }else{
+             // A name in the root directory is looked up as the kernel gives it, without a copy.
+             const bool      root    {parent == FUSE_ROOT_ID};
+             const Entry     *file   {get<BYNAME>(*get<CAT_INODES>(*cat)).find(root ? name : path.data(), 
+                                                                              root ? strlen(name) : path.size(), ino) ? 
+                                      Dbfs::inodeEntry(cat, ino) : nullptr};
+
+             // The columns of a table not loaded yet are known after its load.
+             if(file == nullptr && dir != nullptr && !get<DATA>(*get<ENTRY_ATTR>(*dir))){
+                 bool loaded {false};
+                 if(Dbfs::loadLazy(*Dbfs::inodeName(cat, parent), loaded) == 0 && loaded){
+                     cat  = Dbfs::catalog();
+                     file = get<BYNAME>(*get<CAT_INODES>(*cat)).find(path, ino) ? Dbfs::inodeEntry(cat, ino) : nullptr;
+                 }
+             }
+             if(file == nullptr){
+                 fuse_reply_err(req, ENOENT);
+                 return;
+             }
+             stbuf = Dbfs::entryStat(*file, ino);
+         }
 
-         Dbfs::running.store(Dbfs::running.load(memory_order_relaxed) + 1, memory_order_relaxed); 
+         #ifdef __GNUC__
+         #pragma GCC diagnostic push
+         #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+         #endif
+
+         EntryParam  entry  = {};
+
+         #ifdef __GNUC__
+         #pragma GCC diagnostic pop
+         #endif
+
+         entry.ino           = ino;
+         entry.attr          = stbuf;
+         entry.attr_timeout  = Dbfs::kernelCache ? CACHE_TIMEOUT : ATTR_TIMEOUT;
+         entry.entry_timeout = Dbfs::kernelCache ? CACHE_TIMEOUT : ENTRY_TIMEOUT;
+
+         DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- lookupCb - Found file: <", name, "> inode: ", to_string(entry.ino), " size: ", to_string(entry.attr.st_size)});
+         fuse_reply_entry(req, &entry);
+      }catch(...){
+          exPtr = current_exception();
+	  genericExcPtrHdlr(Dbfs::syslog, exPtr);
+          fuse_reply_err(req, EIO);
+      } 
+    }
+
+    void Dbfs::forgetCb(Request req, Inode ino, unsigned long nlookup) noexcept(true){
+      // The inodes of the tables are never reused (see assignInodes()): only the virtual files are released.
+      if(ino >= FIRST_VIRTUAL)
+          Dbfs::forgetVirtual(ino, nlookup);
+      fuse_reply_none(req);
+    }
+
+    void Dbfs::getattrCb(Request req, Inode ino, FileInfo *fi) noexcept(true){
+      static_cast<void>(fi);
+
+      DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- getattrCb : inode: ", to_string(ino)});
+
+      exception_ptr exPtr; 
 
       try{
          #ifdef __GNUC__
@@ -134,194 +1288,425 @@ namespace dbfs{
          #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
          #endif
 
-         *stbuf = {};
+         Stat          stbuf  = {};
 
          #ifdef __GNUC__
          #pragma GCC diagnostic pop
          #endif
    
-         string fullPath{path}, 
-                fileName{path}; 
-
-         if(fullPath.compare(ROOT_DIR) == 0) {
-	       stbuf->st_mode  = S_IFDIR | 0777;
-               stbuf->st_nlink = 2;
-                
-               goto   END;
+         if(ino == FUSE_ROOT_ID) {
+	       stbuf.st_ino   = ino;
+	       stbuf.st_mode  = S_IFDIR | 0777;
+               stbuf.st_nlink = 2;
+               fuse_reply_attr(req, &stbuf, Dbfs::kernelCache ? CACHE_TIMEOUT : ATTR_TIMEOUT);
+               return;
          }
    
-         Dbfs::extractIds(path, fullPath, fileName);
-   
-         Dbfs::syslog->log(LOG_DEBUG, {"- getattrCb - Path: <", fullPath, "> - File Name<", fileName, ">"});
-   
-         auto file = Dbfs::fsdb.find(fileName);
-         if(file != Dbfs::fsdb.end()){
-	     *stbuf  = get<SSTAT>(file->second);
-             Dbfs::syslog->log(LOG_DEBUG, {"- getattrCb - Found file: <", fileName, "> size: ", to_string(stbuf->st_size), " - owner: <", to_string(stbuf->st_uid), ">"});
+         CatalogPtr        cat    {Dbfs::catalog()};
+         Path              path;
+         if(ino >= FIRST_VIRTUAL && Dbfs::virtualPath(ino, path)){
+             StorePtr        store;
+             const Entry     *table  {nullptr};
+             int             ret     {Dbfs::virtualStore(cat, path, store, table)};
+             if(ret != 0 && ret != -EAGAIN){
+                 fuse_reply_err(req, -ret);
+                 return;
+             }
+             stbuf = Dbfs::virtualStat(*table, store, ino);
+             fuse_reply_attr(req, &stbuf, Dbfs::kernelCache ? CACHE_TIMEOUT : ATTR_TIMEOUT);
+             return;
+         }
 
-             goto   END;
-         }else{
-             res =  -ENOENT;
+         const Entry       *file  {Dbfs::inodeEntry(cat, ino)};
+         if(file == nullptr){
+             fuse_reply_err(req, ENOENT);
+             return;
          }
+
+	 stbuf        = Dbfs::entryStat(*file, ino);
+         DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- getattrCb - Found file: <", *Dbfs::inodeName(cat, ino), "> size: ", to_string(stbuf.st_size), " - owner: <", to_string(stbuf.st_uid), ">"});
+         fuse_reply_attr(req, &stbuf, Dbfs::kernelCache ? CACHE_TIMEOUT : ATTR_TIMEOUT);
       }catch(...){
           exPtr = current_exception();
 	  genericExcPtrHdlr(Dbfs::syslog, exPtr);
-          res =  -ENOENT;
+          fuse_reply_err(req, ENOENT);
       } 
+    }
 
-      END:
+    void Dbfs::opendirCb(Request req, Inode ino, FileInfo *fi) noexcept(true){
+      DBFS_LOG(Dbfs::syslog, LOG_DEBUG, "- opendirCb.");
 
-      Dbfs::running.store(Dbfs::running.load(memory_order_relaxed) - 1, memory_order_relaxed); 
-      return res;
-    }
+      exception_ptr exPtr;
 
-    bool Dbfs::extractIds(const char* buff, string& path, string& file) noexcept(true){
-	 exception_ptr exPtr;
+      try{
+          if(ino != FUSE_ROOT_ID){
+              CatalogPtr    cat   {Dbfs::catalog()};
+              const Entry   *dir  {Dbfs::inodeEntry(cat, ino)};
+              if(dir == nullptr || !Dbfs::isDir(get<ENTRY_KIND>(*dir))){
+                  fuse_reply_err(req, dir == nullptr ? ENOENT : ENOTDIR);
+                  return;
+              }
 
-	 try{
-	     path           = buff;
-	     file           = buff;
-             size_t lastSep = path.find_last_of(PATH_SEPARATOR);
-             if(lastSep != string::npos && lastSep != 0){
-                  path.erase(path.find_last_of(PATH_SEPARATOR), path.size()-1);
-                  file.erase(0, lastSep+1);
-             }else if(lastSep == 0){
-	          path = ROOT_DIR;
-                  file.erase(0, 1);
-             }
-	  }catch(...){
-		exPtr = current_exception();
-		genericExcPtrHdlr(Dbfs::syslog, exPtr);
-		return true;
+              // The columns of a table are listed once it's loaded.
+              bool loaded {false};
+              if(get<ENTRY_KIND>(*dir) == NODE_DIR && !get<DATA>(*get<ENTRY_ATTR>(*dir)) && 
+                 Dbfs::loadLazy(*Dbfs::inodeName(cat, ino), loaded) != 0){
+                  fuse_reply_err(req, EIO);
+                  return;
+              }
           }
 
-	  return false;
+          // The directory is listed from the catalog of its opening, a page at a time. 
+          std::unique_ptr<CatalogPtr> listed {new CatalogPtr(Dbfs::catalog())};
+
+          fi->fh = reinterpret_cast<uint64_t>(listed.get());
+          if(fuse_reply_open(req, fi) == 0) listed.release();
+      }catch(...){
+          exPtr =  current_exception();
+	  genericExcPtrHdlr(Dbfs::syslog, exPtr);
+          fuse_reply_err(req, EIO);
+      }
     }
-    
-    int Dbfs::readdirCb(const char *path, void *buf, fuse_fill_dir_t filler,
-                        off_t offset, FileInfo *fi) noexcept(true){
-   
-      static_cast<void>(offset);
-      static_cast<void>(fi);
-      static_cast<void>(path);
 
-      Dbfs::syslog->log(LOG_DEBUG, "- readdirCb.");
+    void Dbfs::readdirCb(Request req, Inode ino, size_t size, off_t offset, FileInfo *fi) noexcept(true){
+      DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- readdirCb: Offset: ", to_string(offset), " Size: ", to_string(size)});
 
       exception_ptr exPtr;
 
-      int  ret  {0};
-
       try{
-          bool refr {Dbfs::refreshing.load(memory_order_relaxed)};
-
-          unique_lock<mutex> lock(Dbfs::mtxRefresh);
-          while(refr)
-             Dbfs::cndRefresh.wait(lock);
-
-          Dbfs::running.store(Dbfs::running.load(memory_order_relaxed) + 1, memory_order_relaxed); 
+          const CatalogPtr      &cat     {*reinterpret_cast<CatalogPtr*>(fi->fh)};
+          const vector<Filename> &names  {get<BYINODE>(*get<CAT_INODES>(*cat))};
+          const Entries         &entries {get<CAT_ENTRIES>(*cat)};
+          const Entry           *dir     {ino == FUSE_ROOT_ID ? nullptr : Dbfs::inodeEntry(cat, ino)};
+          vector<char>          buf(size);
+          size_t                used     {0};
+          Nodes                 nodes;
+
+          // A table directory lists the nodes of its table after itself: the full rows, the directories of
+          // the virtual files, the columns and the indexes. The virtual files are never listed, the formats
+          // are in the root directory.
+          if(dir != nullptr && get<ENTRY_KIND>(*dir) == NODE_DIR)
+              Dbfs::tableNodes(*Dbfs::inodeName(cat, ino), *get<ENTRY_ATTR>(*dir), nodes);
+          size_t                last     {dir == nullptr ? DOT_ENTRIES + entries.size() : 
+                                            nodes.size() != 0 ? DOT_ENTRIES + nodes.size() - 1 : static_cast<size_t>(DOT_ENTRIES)};
+
+          // The offsets are 0 and 1 for '.' and '..', then the inodes of the tables in the order of assignment:
+          // the inodes are never removed, so an offset always resumes the listing from the same table.
+          for(size_t entry = offset < 0 ? 0 : offset; entry < last; entry++){
+              #ifdef __GNUC__
+              #pragma GCC diagnostic push
+              #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+              #endif
+
+              Stat        stbuf  = {};
+
+              #ifdef __GNUC__
+              #pragma GCC diagnostic pop
+              #endif
+
+              const char  *name  {nullptr};
+
+              if(entry < DOT_ENTRIES){
+                  name          = entry == 0 ? "." : "..";
+                  stbuf.st_ino  = entry == 0 ? ino : FUSE_ROOT_ID;
+                  stbuf.st_mode = S_IFDIR;
+              }else if(dir != nullptr){
+                  const Node &node  {nodes[entry - DOT_ENTRIES + 1]};
+                  const Path &path  {get<NPATH>(node)};
+                  size_t     child  {0};
+                  if(get<NKIND>(node) == NODE_FORMAT || !get<BYNAME>(*get<CAT_INODES>(*cat)).find(path, child)) continue;
+                  name          = path.c_str() + path.rfind(PATH_SEP) + 1;
+                  stbuf.st_ino  = child;
+                  stbuf.st_mode = Dbfs::isDir(get<NKIND>(node)) ? S_IFDIR : S_IFREG;
+              }else{
+                  const Entry &file {entries[entry - DOT_ENTRIES]};
+                  if(get<ENTRY_ATTR>(file) == nullptr || (get<ENTRY_KIND>(file) != NODE_TABLE && 
+                     get<ENTRY_KIND>(file) != NODE_DIR && get<ENTRY_KIND>(file) != NODE_FORMAT)) continue;
+                  name          = names[entry - DOT_ENTRIES].c_str();
+                  stbuf.st_ino  = FIRST_INODE + entry - DOT_ENTRIES;
+                  stbuf.st_mode = get<ENTRY_KIND>(file) == NODE_DIR ? S_IFDIR : S_IFREG;
+              }
 
-          filler(buf, ".", nullptr, 0);
-          filler(buf, "..", nullptr, 0);
-    
-          string fpath{path}; 
-    
-          Dbfs::syslog->log(LOG_DEBUG, {"- readdirCb: Path: <", fpath, ">"});
-    
-          for(auto &eit : Dbfs::fsdb){
-	       filler(buf, eit.first.c_str(), nullptr, 0);
-               Dbfs::syslog->log(LOG_DEBUG, {"- readdirCb: File: <", eit.first, ">"});
+              size_t len {fuse_add_direntry(req, buf.data() + used, size - used, name, &stbuf, entry + 1)};
+              if(len > size - used) break;
+              used += len;
           }
+
+          fuse_reply_buf(req, buf.data(), used);
       }catch(...){
           exPtr =  current_exception();
 	  genericExcPtrHdlr(Dbfs::syslog, exPtr);
-	  ret   =  -EIO;
+          fuse_reply_err(req, EIO);
       }
+    }
+
+    void Dbfs::releasedirCb(Request req, Inode ino, FileInfo *fi) noexcept(true){
+      static_cast<void>(ino);
 
-      Dbfs::running.store(Dbfs::running.load(memory_order_relaxed) - 1, memory_order_relaxed); 
-      return ret;
+      delete reinterpret_cast<CatalogPtr*>(fi->fh);
+      fuse_reply_err(req, 0);
     }
 
-    int Dbfs::openCb(const char *path, FileInfo *fi) noexcept(true){
-      Dbfs::syslog->log(LOG_DEBUG, "- openCb.");
-    
-      static_cast<void>(path);
-      static_cast<void>(fi);
+    int Dbfs::loadLazy(const string& fileName, bool& loaded) noexcept(true){
+      exception_ptr exPtr; 
+
+      loaded = false;
+
+      try{
+          {
+              FilesystemPtr fs   {Dbfs::tables()};
+              auto          file = fs->find(fileName);
+              if(file == fs->end())         return -ENOENT;
+              if(get<DATA>(file->second))   return 0;
+          }
+
+          // Concurrent first readers of a table wait on the latch of that table only:
+          // the reads of the tables already in memory are not delayed by the load.
+          shared_ptr<mutex> latch;
+          {
+              lock_guard<mutex>  lock(Dbfs::mtxLatches);
+              shared_ptr<mutex>& tableLatch = Dbfs::latches[fileName];
+              if(!tableLatch) tableLatch = make_shared<mutex>();
+              latch = tableLatch;
+          }
+          lock_guard<mutex> tableLock(*latch);
+
+          {
+              FilesystemPtr fs   {Dbfs::tables()};
+              auto          file = fs->find(fileName);
+              if(file == fs->end())         return -ENOENT;
+              if(get<DATA>(file->second))   return 0;
+          }
+
+          DBFS_LOG(Dbfs::syslog, LOG_INFO, {"- loadLazy : loading table: ", fileName});
+          TableAttr  tableAttr;
+          Dbfs::getInstance()->dbconn->fetchTable(fileName, tableAttr);
+
+          lock_guard<mutex> loadLock(Dbfs::mtxLoad);
+          Filesystem next {*Dbfs::tables()};
+          auto       file = next.find(fileName);
+          if(file == next.end())  return -ENOENT;
+          if(!get<DATA>(file->second)){
+              get<DATA>(tableAttr)->touch(++Dbfs::accessTick);
+              file->second = move(tableAttr);
+              loaded       = true;
+              if(Dbfs::evicted.erase(fileName) != 0) Dbfs::reloads++;
+          }
+          Dbfs::enforceBudget(next, fileName);
+          Dbfs::publish(move(next));
+      }catch(DbConnExc& ex){
+          DBFS_LOG(Dbfs::syslog, LOG_ERR, {"- loadLazy : psql exception: ", ex.what()});
+          return -EIO;
+      }catch(...){
+          exPtr = current_exception();
+          genericExcPtrHdlr(Dbfs::syslog, exPtr);
+          return -EIO;
+      }
 
       return 0;
     }
 
-    int Dbfs::readCb(const char *path, char *buf, size_t size, off_t offset,
-                     FileInfo *fi) noexcept(true){
-    
-      static_cast<void>(fi);
+    void Dbfs::enforceBudget(Filesystem& next, const string& keep) noexcept(true){
+      if(Dbfs::memBudget == 0) return;
+
+      size_t         resident {0};
+      RenderedBytes  rendered;
+
+      // The formats rendered are counted with their table: they are dropped with it.
+      {
+          lock_guard<mutex> lock(Dbfs::mtxRendered);
+          for(auto &file : Dbfs::rendered){
+              auto  source  = get<REN_SOURCE>(file.second).lock();
+              if(source) rendered[source.get()] += get<REN_STORE>(file.second)->memory();
+          }
+      }
+
+      for(auto &table : next)
+          resident += Dbfs::tableMemory(table.second, rendered);
+
+      // Drop the least recently read tables: they are loaded again at the next access.
+      while(resident > Dbfs::memBudget){
+          auto           lru    = next.end();
+          unsigned long  oldest {0};
 
-      Dbfs::syslog->log(LOG_DEBUG, {"- readCb: Full Path: ", path, " Size requested:", to_string(size), " Offset: ", to_string(offset)});
+          for(auto table = next.begin(); table != next.end(); ++table){
+              const StorePtr &store {get<DATA>(table->second)};
+              if(!store || Dbfs::tableMemory(table->second, rendered) == 0 || table->first == keep) continue;
+
+              if(lru == next.end() || store->accessed() < oldest){
+                  lru    = table;
+                  oldest = store->accessed();
+              }
+          }
+          if(lru == next.end()) break;
+
+          resident -= Dbfs::tableMemory(lru->second, rendered);
+          get<DATA>(lru->second).reset();
+          get<COLS>(lru->second).reset();
+          get<RIDX>(lru->second).reset();
+          get<VIDX>(lru->second).reset();
+          get<VERS>(lru->second).clear();
+          Dbfs::evicted.insert(lru->first);
+          Dbfs::evictions++;
+
+          DBFS_LOG(Dbfs::syslog, LOG_NOTICE, {"- enforceBudget : evicted table: ", lru->first, " - resident bytes: ", to_string(resident),
+                                              " - evictions: ", to_string(Dbfs::evictions), " - reloads: ", to_string(Dbfs::reloads)});
+      }
+    }
+
+    void Dbfs::openCb(Request req, Inode ino, FileInfo *fi) noexcept(true){
+      DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- openCb : inode: ", to_string(ino)});
 
       exception_ptr exPtr; 
 
       int  ret  {0};
 
-      try{
-          bool refr {Dbfs::refreshing.load(memory_order_relaxed)};
-          unique_lock<mutex> lock(Dbfs::mtxRefresh);
-          while(refr)
-             Dbfs::cndRefresh.wait(lock);
-
-          Dbfs::running.store(Dbfs::running.load(memory_order_relaxed) + 1, memory_order_relaxed); 
+      if((fi->flags & O_ACCMODE) != O_RDONLY){
+          fuse_reply_err(req, EACCES);
+          return;
+      }
 
-          string fullPath    {""},
-                 fileName    {""}; 
-    
-          Dbfs::extractIds(path, fullPath, fileName);
-    
-          Dbfs::syslog->log(LOG_DEBUG, {"- readCb: Path: ", fullPath, " File Name: ", fileName});
-        
-          auto file = Dbfs::fsdb.find(fileName);
-          if(file != Dbfs::fsdb.end() ){
-              size_t len = get<SSTAT>(file->second).st_size;
-              Dbfs::syslog->log(LOG_DEBUG, {"- readCb: Size: ", to_string(len)});
-    
-              if(offset < 0){
-                  Dbfs::syslog->log(LOG_ERR, "- readCb: Offset negative.");
+      try{
+          CatalogPtr      opened {Dbfs::catalog()};
+          CatalogPtr      cat    {opened};
+          const Entry     *file  {nullptr};
+          StorePtr        store;
+          bool            loaded {false};
+          Path            path;
+
+          // The store is held by the open file: a refresh or an eviction publishing 
+          // a new set of tables meanwhile doesn't release it, and readCb() doesn't 
+          // resolve the name again. A virtual file holds the range of the table it
+          // names at the time of its opening.
+          if(ino >= FIRST_VIRTUAL && Dbfs::virtualPath(ino, path)){
+              ret = Dbfs::openVirtual(path, cat, store, file, loaded);
+              if(ret != 0) goto END;
+          }else{
+              const Entry     *found {Dbfs::inodeEntry(opened, ino)};
+
+              if(found == nullptr){
                   ret  =  -ENOENT;
                   goto END;
               }
-    
-              if(len > INT_MAX){
-                  Dbfs::syslog->log(LOG_ERR, "- readCb: INT_MAX exceeded.");
-                  ret  =  -ENOENT;
+              if(Dbfs::isDir(get<ENTRY_KIND>(*found))){
+                  ret  =  -EISDIR;
                   goto END;
               }
-        
-              if (static_cast<size_t>(offset) >= len){
-                  Dbfs::syslog->log(LOG_ERR, "- readCb: end of file exceeded.");
-                  goto END;
-              } 
 
-              const TableData& tdata = get<DATA>(file->second);  
+              const Filename  *name  {Dbfs::inodeName(opened, get<ENTRY_TABLE>(*found))};
+
+              file = found;
+              for(int retry = 0; file != nullptr; retry++){
+                  store = Dbfs::entryStore(*file);
+                  if(store || retry == LAZY_RETRIES) break;
+
+                  ret = Dbfs::loadLazy(*name, loaded);
+                  if(ret != 0) goto END;
 
-              if (offset + size > len) {
-                      Dbfs::syslog->log(LOG_DEBUG, {"- readCb: reading all the available bytes from: ", to_string(offset), " to: ",  to_string(offset+len)});
-		      copy(tdata.data() + offset, tdata.data() + len, buf);
-                      ret =   len - offset;
-                      goto END;
+                  cat  = Dbfs::catalog();
+                  file = Dbfs::inodeEntry(cat, ino);
               }
-            
-              Dbfs::syslog->log(LOG_DEBUG, {"- readCb: reading from: ", to_string(offset), " to: ",  to_string(offset+len)});
-              copy(tdata.data() + offset, tdata.data() + offset + size, buf);
+          }
 
-              ret =   size;
+          if(file == nullptr){
+              ret  =  -ENOENT;
+              goto END;
+          }
+          if(!store){
+              ret  =  -EIO;
+              goto END;
           }
+
+          // Opening a column is an access to its table, for the memory budget.
+          if(get<DATA>(*get<ENTRY_ATTR>(*file)) && store != get<DATA>(*get<ENTRY_ATTR>(*file)))
+              get<DATA>(*get<ENTRY_ATTR>(*file))->touch(++Dbfs::accessTick);
+
+          // The kernel could still have the size of the empty placeholder, or of a format
+          // not rendered yet. 
+          if(loaded || get<ENTRY_KIND>(*file) == NODE_FORMAT) 
+              fi->direct_io  = 1;
+          else if(Dbfs::kernelCache) 
+              fi->keep_cache = 1;
+
+          std::unique_ptr<StorePtr> handle {new StorePtr(store)};
+          fi->fh = reinterpret_cast<uint64_t>(handle.get());
+          if(fuse_reply_open(req, fi) == 0) handle.release();
+          return;
       }catch(...){
 	  exPtr = current_exception(); 
 	  genericExcPtrHdlr(Dbfs::syslog, exPtr);
-          ret =   -ENOENT;
+          ret =   -EIO;
       }     
 
       END:
 
-      Dbfs::running.store(Dbfs::running.load(memory_order_relaxed) - 1, memory_order_relaxed); 
-      return ret;
+      fuse_reply_err(req, -ret);
+    }
+
+    void Dbfs::readCb(Request req, Inode ino, size_t size, off_t offset, FileInfo *fi) noexcept(true){
+      DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- readCb: inode: ", to_string(ino), " Size requested:", to_string(size), " Offset: ", to_string(offset)});
+
+      exception_ptr exPtr; 
+
+      try{
+          // With the kernel cache the pages are shared by all the open files: they are filled 
+          // with the current content of the table, the one the last invalidation refers to.
+          // The reads reaching dbfs in that mode are few: the name is resolved again.
+          StorePtr  store  {Dbfs::kernelCache ? Dbfs::currentStore(ino) : StorePtr()};
+          if(!store)
+              store = *reinterpret_cast<StorePtr*>(fi->fh);
+
+          store->touch(++Dbfs::accessTick);
+
+          size_t len = store->size();
+          DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- readCb: Size: ", to_string(len)});
+    
+          if(offset < 0){
+              DBFS_LOG(Dbfs::syslog, LOG_ERR, "- readCb: Offset negative.");
+              fuse_reply_err(req, EINVAL);
+              return;
+          }
+    
+          if (static_cast<size_t>(offset) >= len){
+              DBFS_LOG(Dbfs::syslog, LOG_DEBUG, "- readCb: end of file exceeded.");
+              fuse_reply_buf(req, nullptr, 0);
+              return;
+          } 
+
+          DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- readCb: reading from: ", to_string(offset), " bytes: ",  to_string(size)});
+
+          // Sent without copies when possible: spliced from the file of the store to the kernel,
+          // or written straight from the memory of the store. Only the other stores are copied.
+          size_t        count     {std::min(size, len - offset)},
+                        position  {0};
+          int           fd        {Dbfs::spliceReads ? store->descriptor(position) : -1};
+          const char    *memory   {store->contiguous()};
+
+          if(fd != -1){
+              struct fuse_bufvec  bufv  = FUSE_BUFVEC_INIT(count);
+              bufv.buf[0].flags         = static_cast<enum fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+              bufv.buf[0].fd            = fd;
+              bufv.buf[0].pos           = position + offset;
+              fuse_reply_data(req, &bufv, FUSE_BUF_SPLICE_MOVE);
+          }else if(memory != nullptr){
+              fuse_reply_buf(req, memory + offset, count);
+          }else{
+              vector<char>  buf(count);
+              size_t        got  {store->read(buf.data(), buf.size(), offset)};
+              fuse_reply_buf(req, buf.data(), got);
+          }
+      }catch(...){
+	  exPtr = current_exception(); 
+	  genericExcPtrHdlr(Dbfs::syslog, exPtr);
+          fuse_reply_err(req, EIO);
+      }     
+    }
+
+    void Dbfs::releaseCb(Request req, Inode ino, FileInfo *fi) noexcept(true){
+      static_cast<void>(ino);
+
+      delete reinterpret_cast<StorePtr*>(fi->fh);
+      fuse_reply_err(req, 0);
     }
 
     Dbfs*  Dbfs::setInstance(const string& pdir, Syslog* slog, const string& confFile , const string& tableOwner) noexcept(false){
@@ -345,23 +1730,37 @@ namespace dbfs{
 
     Dbfs::Dbfs(const string& dir, Syslog* slog, const string& confFile, const string& tableOwner) 
                : mountPoint{dir}, configurationFile{confFile}, owner{tableOwner}, dbName{""}, 
-                 userName{""}, dbAddress{""}, dbPort{""}, dbPwd{""}, dbconn{DBIface::getInstance().getDbConn("postgresql", slog)} {
+                 userName{""}, dbAddress{""}, dbPort{""}, dbPwd{""}, dbconn{DBIface::getInstance().getDbConn("postgresql", slog)}, 
+                 replication{false}, lazy{false}, restored{false}, warmStart{false}, refreshWarned{false} {
 
          syslog           = slog;
 
          fuse             = {};
 
+         fuse.lookup      = Dbfs::lookupCb;
+         fuse.forget      = Dbfs::forgetCb;
          fuse.getattr     = Dbfs::getattrCb;
+         fuse.opendir     = Dbfs::opendirCb;
+         fuse.readdir     = Dbfs::readdirCb;
+         fuse.releasedir  = Dbfs::releasedirCb;
          fuse.open        = Dbfs::openCb;
          fuse.read        = Dbfs::readCb;
-         fuse.readdir     = Dbfs::readdirCb;
+         fuse.release     = Dbfs::releaseCb;
+         fuse.init        = Dbfs::initCb;
+         fuse.destroy     = Dbfs::destroyCb;
+
+         if(pipe(Dbfs::wakePipe) == -1 || 
+            fcntl(Dbfs::wakePipe[0], F_SETFL, O_NONBLOCK) == -1 || fcntl(Dbfs::wakePipe[1], F_SETFL, O_NONBLOCK) == -1){
+              DBFS_LOG(Dbfs::syslog, LOG_ERR, {"- Dbfs cons: creating the refresh pipe", strerror(errno)});
+              throw(string("Dbfs cons: error creating the refresh pipe."));
+         }
 
          Dbfs::saction.sa_sigaction = &Dbfs::refreshHdlr;
          Dbfs::saction.sa_flags     = SA_SIGINFO | SA_RESTART; // TODO: check
          sigfillset(&Dbfs::saction.sa_mask);
 
          if(sigaction(SIGUSR2, &Dbfs::saction, nullptr) ==  -1) {
-              Dbfs::syslog->log(LOG_ERR, {"- Dbfs cons: setting signal handler", strerror(errno)});
+              DBFS_LOG(Dbfs::syslog, LOG_ERR, {"- Dbfs cons: setting signal handler", strerror(errno)});
               throw(string("Dbfs cons: error setting signal handler."));
 	 }
     }
@@ -382,34 +1781,175 @@ namespace dbfs{
          dbPort      = port;
          dbPwd       = pwd;
     
-        Dbfs::syslog->log(LOG_DEBUG, "- initFileSystem: begin.");
+        DBFS_LOG(Dbfs::syslog, LOG_DEBUG, "- initFileSystem: begin.");
         bool ret = true;
+
+        // Warm start: serve the tables of the last snapshot, the db is read later by scheduleLoop().
+        if(snapshotFile.size() != 0 && !replication && !restored){
+            restored = true;
+            try{
+                Filesystem next {*Dbfs::tables()};
+                if(Snapshot::restore(snapshotFile, next, Dbfs::syslog)){
+                    // The snapshot has the rows only: the tables are loaded again to have their columns.
+                    if(Dbfs::tableDirs || Dbfs::formats.size() != 0)
+                        for(auto &table : next)
+                            if(!get<COLS>(table.second)) get<VERS>(table.second).clear();
+                    Dbfs::publish(move(next));
+                    warmStart = true;
+                    return true;
+                }
+            }catch(...){
+                genericExcPtrHdlr(Dbfs::syslog, current_exception());
+            }
+        }
+
         try{
-            Dbfs::syslog->log(LOG_DEBUG, {"- initFileSystem - connecting - db: ", dbname, " usr: ", user, " addr: ", address, " port: ", port });
+            DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- initFileSystem - connecting - db: ", dbname, " usr: ", user, " addr: ", address, " port: ", port });
             dbconn->connect(dbname, user, address, port, pwd);
-            Dbfs::syslog->log(LOG_DEBUG, {"- initFileSystem - loading tables - owner: ", owner });
-            if(owner.size() != 0 && !Dbfs::refreshing)
-                dbconn->loadDbByOwner(Dbfs::fsdb, owner);
-            else
-                dbconn->loadDbByList( Dbfs::fsdb, configurationFile);
 
-            if(Dbfs::syslog->getPriority() == LOG_DEBUG) dbconn->printDebug(Dbfs::fsdb);
-
-        }catch(DbConnExc* ex){
-            cerr << ex->what() << endl;
-            Dbfs::syslog->log(LOG_ERR, {"- initFileSystem: psql exception:", ex->what()});
+            // The first load reads the snapshot exported by the replication slot,
+            // so the stream starts exactly where the loaded data ends.
+            if(replication && !replica){
+                replica.reset(new PsqlReplication(Dbfs::syslog));
+                replica->connect(dbname, user, address, port, pwd);
+                dbconn->setSnapshot(replica->createSlot());
+            }
+
+            if((lazy || Dbfs::memBudget != 0) && replication){
+                DBFS_LOG(Dbfs::syslog, LOG_WARNING, "- initFileSystem - lazy loading and memory budget disabled by replication.");
+                Dbfs::memBudget = 0;
+            }
+            dbconn->setLazy((lazy || Dbfs::memBudget != 0) && !replication);
+
+            // Loaded on the side: the readers keep the current tables until the new ones are published.
+            Filesystem next {*Dbfs::tables()};
+
+            DBFS_LOG(Dbfs::syslog, LOG_DEBUG, {"- initFileSystem - loading tables - owner: ", owner });
+            if(owner.size() != 0)
+                dbconn->loadDbByOwner(next, owner);
+            else
+                dbconn->loadDbByList( next, configurationFile);
+            dbconn->setSnapshot("");
+
+            if(Dbfs::syslog->enabled(LOG_DEBUG)) dbconn->printDebug(next);
+            Dbfs::enforceBudget(next, "");
+            Dbfs::publish(move(next));
+            saveSnapshot();
+
+        }catch(DbConnExc& ex){
+            dbconn->setSnapshot("");
+            cerr << ex.what() << endl;
+            DBFS_LOG(Dbfs::syslog, LOG_ERR, {"- initFileSystem: psql exception:", ex.what()});
             ret  =  false;
         }
 	return ret;
     }
 
+void  Dbfs::setLoaders(size_t num) noexcept(true){
+    dbconn->setLoaders(num);
+}
+
+void  Dbfs::setLoadMode(dbfsutils::LOADMODE mode) noexcept(true){
+    dbconn->setLoadMode(mode);
+    Dbfs::escapedFields = mode == dbfsutils::LOAD_COPY;
+}
+
+void  Dbfs::setFetchRows(size_t rows) noexcept(true){
+    dbconn->setFetchRows(rows);
+}
+
+void  Dbfs::setChangeCheck(dbfsutils::CHANGECHECK check) noexcept(true){
+    dbconn->setChangeCheck(check);
+}
+
+void  Dbfs::setNotifyChannel(const string& channel) noexcept(true){
+    notifyChannel = channel;
+}
+
+void  Dbfs::setReplication(bool enable) noexcept(true){
+    replication = enable;
+    dbconn->setRowStore(enable);
+}
+
+void  Dbfs::setLazy(bool enable) noexcept(true){
+    lazy = enable;
+}
+
+void  Dbfs::setMemBudget(size_t bytes) noexcept(true){
+    Dbfs::memBudget = bytes;
+}
+
+void  Dbfs::setStoreEngine(dbfsutils::STOREENGINE engine) noexcept(true){
+    dbconn->setStoreEngine(engine);
+}
+
+void  Dbfs::setSnapshotFile(const string& path) noexcept(true){
+    snapshotFile = path;
+}
+
+void  Dbfs::setKernelCache(bool enable) noexcept(true){
+    Dbfs::kernelCache = enable;
+}
+
+void  Dbfs::setTableDirs(bool enable) noexcept(true){
+    Dbfs::tableDirs = enable;
+    dbconn->setColumnFiles(enable);
+    dbconn->setRowIndex(enable);
+}
+
+void  Dbfs::setFormats(const OutFormats& outFormats, bool header) noexcept(true){
+    Dbfs::formats      = outFormats;
+    Dbfs::formatHeader = header;
+    dbconn->setColumnNames(outFormats.size() != 0);
+}
+
+int  Dbfs::mountFileSystem(int argc, char *argv[]) noexcept(false){
+    FuseArgs              args         = FUSE_ARGS_INIT(argc, argv);
+    char                  *mountPath   {nullptr};
+    int                   multiThread  {0},
+                          foreground   {0},
+                          err          {-1};
+    struct fuse_chan      *chan        {nullptr};
+    struct fuse_session   *session     {nullptr};
+
+    if(fuse_parse_cmdline(&args, &mountPath, &multiThread, &foreground) != -1 &&
+       (chan = fuse_mount(mountPath, &args)) != nullptr){
+        Dbfs::channel = chan;
+
+        session = fuse_lowlevel_new(&args, &fuse, sizeof(fuse), this);
+        if(session != nullptr){
+            if(fuse_set_signal_handlers(session) != -1){
+                fuse_session_add_chan(session, chan);
+                if(fuse_daemonize(foreground) != -1)
+                    err = multiThread ? fuse_session_loop_mt(session) : fuse_session_loop(session);
+                fuse_remove_signal_handlers(session);
+                fuse_session_remove_chan(chan);
+            }
+            fuse_session_destroy(session);
+        }
+        Dbfs::channel = nullptr;
+        fuse_unmount(mountPath, chan);
+    }
+
+    free(mountPath);
+    fuse_opt_free_args(&args);
+
+    return err == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 bool  Dbfs::refreshDb(void) noexcept(false){
-    if(dbName.size() == 0    || userName.size() == 0 ||
-       dbAddress.size() == 0 || dbPort.size() == 0   ||
-       dbPwd.size() == 0 )
-            return false;
-       
-    return initFileSystem(dbName, userName, dbAddress, dbPort, dbPwd);
+    // Without a password libpq uses .pgpass, PGPASSWORD or a trust rule of the server.
+    bool ret {dbName.size() != 0    && userName.size() != 0 &&
+              dbAddress.size() != 0 && dbPort.size() != 0   &&
+              initFileSystem(dbName, userName, dbAddress, dbPort, dbPwd)};
+
+    // Logged once for every run of failed refreshes: the tables in memory are still served.
+    if(!ret && !refreshWarned)
+        DBFS_LOG(Dbfs::syslog, LOG_WARNING, {"- refreshDb : can't refresh the tables - db: ", dbName, " usr: ", userName, 
+                                             " addr: ", dbAddress, " port: ", dbPort});
+    refreshWarned = !ret;
+
+    return ret;
 }
 
 
@@ -30,7 +30,7 @@ void paramError(const char* progname, const char* err=nullptr){
     cerr << "dbfs - Mounting a db like a file system. GBonacini - (C) 2017   " << endl;
     cerr << "Version: " << VERSION << endl;
     cerr << "Syntax: " << endl;
-    cerr << "       " << progname << " [-m mountpoint] [-d db_name] [-u user] [-a address] [-p port] [-o owner] [-f filepath] [-P password] [-D] | [-h]" << endl;
+    cerr << "       " << progname << " [-m mountpoint] [-d db_name] [-u user] [-a address] [-p port] [-o owner] [-f filepath] [-P password] [-j connections] [-L loader] [-b rows] [-C check] [-n channel] [-r] [-l] [-M bytes] [-e engine] [-S snapshot] [-K] [-T] [-F formats] [-D] | [-h]" << endl;
     cerr << "       " << "-m sets the mount point." << endl;
     cerr << "       " << "-d sets the db name."    << endl;
     cerr << "       " << "-u sets the user name."  << endl;
@@ -39,6 +39,19 @@ void paramError(const char* progname, const char* err=nullptr){
     cerr << "       " << "-o sets the user name of the tables' owner." << endl;
     cerr << "       " << "-p sets the db port."    << endl;
     cerr << "       " << "-P sets the db password." << endl;
+    cerr << "       " << "-j sets the number of db connections used to load the tables." << endl;
+    cerr << "       " << "-L sets the loader mode: select (default), copy or cursor." << endl;
+    cerr << "       " << "-b sets the number of rows fetched for each batch in cursor mode." << endl;
+    cerr << "       " << "-C skips the unchanged tables during a refresh: stats or xmin." << endl;
+    cerr << "       " << "-n sets the db channel listened for refresh notifications." << endl;
+    cerr << "       " << "-r keeps the tables in sync using logical replication." << endl;
+    cerr << "       " << "-l loads the data of a table at its first access." << endl;
+    cerr << "       " << "-M sets the memory budget for the tables in memory, suffixes K, M and G are accepted." << endl;
+    cerr << "       " << "-e sets the storage of the tables in memory: flat (default), lz4, memfd or columnar." << endl;
+    cerr << "       " << "-S sets the snapshot file used for warm restarts." << endl;
+    cerr << "       " << "-K lets the kernel cache the tables until they are reloaded." << endl;
+    cerr << "       " << "-T mounts every table as a directory, with a file for each column." << endl;
+    cerr << "       " << "-F adds a file for each table in other formats: csv, tsv, jsonl, arrow; header adds the column names to csv and tsv." << endl;
     cerr << "       " << "-D sets the debug mode." << endl;
     cerr << "       " << "-h print this help message." << endl;
 
@@ -60,10 +73,24 @@ int main(int argc, char *argv[]) {
                        port        {""},
                        pwd         {""},
                        tablesOwner {""},
-                       cfgFile     {""};
-        const char     flags[]     {"m:d:u:a:p:P:f:o:hD"};
+                       cfgFile     {""},
+                       channel     {""},
+                       snapFile    {""};
+        const char     flags[]     {"m:d:u:a:p:P:f:o:j:L:b:C:n:rlM:e:S:KTF:hD"};
         
         int            c           {0};
+        size_t         loaders     {1};
+        LOADMODE       loadMode    {LOAD_SELECT};
+        size_t         fetchRows   {10000};
+        size_t         memBudget   {0};
+        CHANGECHECK    changeCheck {CHECK_NONE};
+        STOREENGINE    storeEngine {ENGINE_FLAT};
+        bool           replication {false};
+        bool           lazy        {false};
+        bool           kernelCache {false};
+        bool           tableDirs   {false};
+        bool           fmtHeader   {false};
+        OutFormats     formats;
         bool           debug       {false};
     
         vector<string> parVals;
@@ -99,6 +126,91 @@ int main(int argc, char *argv[]) {
                     case 'o':
                              tablesOwner = optarg;
                     break;
+                    case 'j':
+                             try{
+                                 loaders = stoul(optarg);
+                             }catch(...){
+                                 paramError(argv[0], "Invalid number of connections.");
+                             }
+                    break;
+                    case 'L':
+                             if(string(optarg) == "select")
+                                 loadMode = LOAD_SELECT;
+                             else if(string(optarg) == "copy")
+                                 loadMode = LOAD_COPY;
+                             else if(string(optarg) == "cursor")
+                                 loadMode = LOAD_CURSOR;
+                             else
+                                 paramError(argv[0], "Invalid loader mode.");
+                    break;
+                    case 'b':
+                             try{
+                                 fetchRows = stoul(optarg);
+                             }catch(...){
+                                 paramError(argv[0], "Invalid batch size.");
+                             }
+                    break;
+                    case 'C':
+                             if(string(optarg) == "stats")
+                                 changeCheck = CHECK_STATS;
+                             else if(string(optarg) == "xmin")
+                                 changeCheck = CHECK_XMIN;
+                             else
+                                 paramError(argv[0], "Invalid change check.");
+                    break;
+                    case 'n':
+                             channel     = optarg;
+                    break;
+                    case 'r':
+                             replication = true;
+                    break;
+                    case 'l':
+                             lazy        = true;
+                    break;
+                    case 'M':
+                             try{
+                                 size_t  pos  {0};
+                                 memBudget    = stoul(optarg, &pos);
+                                 switch(optarg[pos]){
+                                     case 'G': case 'g':  memBudget <<= 30; break;
+                                     case 'M': case 'm':  memBudget <<= 20; break;
+                                     case 'K': case 'k':  memBudget <<= 10; break;
+                                     case '\0':                             break;
+                                     default:             throw(string("Invalid suffix."));
+                                 }
+                             }catch(...){
+                                 paramError(argv[0], "Invalid memory budget.");
+                             }
+                    break;
+                    case 'S':
+                             snapFile    = optarg;
+                    break;
+                    case 'K':
+                             kernelCache = true;
+                    break;
+                    case 'T':
+                             tableDirs   = true;
+                    break;
+                    case 'F':
+                             if(!TableFormat::parse(optarg, formats, fmtHeader))
+                                 paramError(argv[0], "Invalid output format.");
+                    break;
+                    case 'e':
+                             if(string(optarg) == "flat")
+                                 storeEngine = ENGINE_FLAT;
+                             else if(string(optarg) == "columnar")
+                                 storeEngine = ENGINE_COLUMNAR;
+                             #ifdef HAVE_LIBLZ4
+                             else if(string(optarg) == "lz4")
+                                 storeEngine = ENGINE_LZ4;
+                             #endif
+                             #ifdef SYS_memfd_create
+                             else if(string(optarg) == "memfd")
+                                 storeEngine = ENGINE_MEMFD;
+                             #endif
+                             else
+                                 paramError(argv[0], "Invalid or unavailable storage engine.");
+                    break;
                     case 'D':
 		             debug       = true;
                     break;
@@ -119,7 +231,7 @@ int main(int argc, char *argv[]) {
         if(debug)
             syslog.setPriority(LOG_UPTO (LOG_DEBUG));
         else
-            syslog.setPriority(LOG_UPTO (LOG_WARNING));
+            syslog.setPriority(LOG_UPTO (LOG_NOTICE));
 
         parVals.push_back(mountpoint); 
     
@@ -132,13 +244,26 @@ int main(int argc, char *argv[]) {
         }
 
         Dbfs* dbfs          {Dbfs::setInstance(mountpoint, &syslog, cfgFile, tablesOwner)};
+        dbfs->setLoaders(loaders);
+        dbfs->setLoadMode(loadMode);
+        dbfs->setFetchRows(fetchRows);
+        dbfs->setChangeCheck(changeCheck);
+        dbfs->setNotifyChannel(channel);
+        dbfs->setReplication(replication);
+        dbfs->setLazy(lazy);
+        dbfs->setMemBudget(memBudget);
+        dbfs->setStoreEngine(storeEngine);
+        dbfs->setSnapshotFile(snapFile);
+        dbfs->setKernelCache(kernelCache);
+        dbfs->setTableDirs(tableDirs);
+        dbfs->setFormats(formats, fmtHeader);
 
         if(!dbfs->initFileSystem(dbname, user, address, port, pwd)){
 	   cerr << "Init Error: File System." << endl;
            throw(string("Init Error: File System."));	   
 	};
 
-        fuseErr     =  fuse_main(paramsc, paramsv.get(), &(dbfs->fuse), nullptr);
+        fuseErr     =  dbfs->mountFileSystem(paramsc, paramsv.get());
 
     }catch(DbConnExc& ex){
         cerr << ex.what() << endl;
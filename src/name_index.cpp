@@ -0,0 +1,104 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <name_index.hpp>
+
+using std::string;
+using std::vector;
+using std::get;
+
+namespace dbfsutils{
+
+NameIndex::NameIndex(void)
+                     : slots(INITIAL_SLOTS, Slot(0, 0, 0, string::npos)), used{0}{}
+
+uint64_t NameIndex::hash(const char* name, size_t len) noexcept(true){
+     // FNV-1a
+     uint64_t  value  {14695981039346656037ULL};
+     for(size_t i = 0; i < len; i++){
+          value ^= static_cast<unsigned char>(name[i]);
+          value *= 1099511628211ULL;
+     }
+     return value;
+}
+
+bool NameIndex::empty(const Slot& slot) noexcept(true){
+     return get<SVALUE>(slot) == string::npos;
+}
+
+bool NameIndex::insert(const char* name, size_t len, size_t value) noexcept(false){
+     size_t  existing  {0};
+     if(find(name, len, existing)) return false;
+
+     // At most half full: the probe sequences stay short.
+     if((used + 1) * 2 > slots.size()) grow();
+
+     uint64_t  hval   {hash(name, len)};
+     size_t    mask   {slots.size() - 1};
+     size_t    pos    {static_cast<size_t>(hval) & mask};
+     while(!empty(slots[pos]))
+          pos = (pos + 1) & mask;
+
+     slots[pos] = Slot(hval, arena.size(), len, value);
+     arena.insert(arena.end(), name, name + len);
+     used++;
+
+     return true;
+}
+
+bool NameIndex::find(const char* name, size_t len, size_t& value) const noexcept(true){
+     uint64_t  hval   {hash(name, len)};
+     size_t    mask   {slots.size() - 1};
+
+     for(size_t pos = static_cast<size_t>(hval) & mask; !empty(slots[pos]); pos = (pos + 1) & mask){
+          const Slot &slot {slots[pos]};
+          if(get<SHASH>(slot) == hval && get<SLEN>(slot) == len && 
+             memcmp(arena.data() + get<SOFFSET>(slot), name, len) == 0){
+               value = get<SVALUE>(slot);
+               return true;
+          }
+     }
+
+     return false;
+}
+
+bool NameIndex::find(const string& name, size_t& value) const noexcept(true){
+     return find(name.data(), name.size(), value);
+}
+
+size_t NameIndex::size(void) const noexcept(true){
+     return used;
+}
+
+void NameIndex::grow(void) noexcept(false){
+     vector<Slot>  bigger(slots.size() * 2, Slot(0, 0, 0, string::npos));
+     size_t        mask  {bigger.size() - 1};
+
+     // The hashes are kept in the slots: the names aren't read again.
+     for(auto &slot : slots){
+          if(empty(slot)) continue;
+
+          size_t pos {static_cast<size_t>(get<SHASH>(slot)) & mask};
+          while(!empty(bigger[pos]))
+               pos = (pos + 1) & mask;
+          bigger[pos] = slot;
+     }
+
+     slots.swap(bigger);
+}
+
+} // end namespace dbfsutils
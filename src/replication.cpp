@@ -0,0 +1,399 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <replication.hpp>
+
+using std::string;
+using std::get;
+using std::move;
+using std::max;
+using std::min;
+using std::to_string;
+
+using syslogwrp::Syslog; 
+
+namespace dbfsutils{
+
+    enum  REPLCONST  { STATUS_SEC=10, STATUS_LEN=34, XLOGDATA_HDR=25, KEEPALIVE_LEN=18 };
+
+    const time_t     PG_EPOCH_OFFSET   {946684800};
+
+PsqlReplication::PsqlReplication(Syslog *slog)
+                     : syslog{slog}, conn{nullptr}, started{false}, inTransaction{false},
+                       lastReceived{0}, lastCommit{0}, lastConfirmed{0}, lastStatus{0}{}
+
+PsqlReplication::~PsqlReplication(){
+        close();
+}
+
+void PsqlReplication::connect(string dbname, string user, string hostAddr, string port, string pwd) noexcept(false){
+        close();
+
+        // An empty password is left out: "password= hostaddr=..." would make the rest its value.
+        connectionString  = "dbname=" + dbname +  " user=" + user + (pwd.size() != 0 ? " password=" + pwd : "") + \
+                          " hostaddr=" + hostAddr + " port=" + port + " replication=database";
+        conn              = PQconnectdb(connectionString.c_str());
+        if(PQstatus(conn) == CONNECTION_BAD)
+                throw DbConnExc(string("Replication Connection Error: ").append(PQerrorMessage(conn)));
+}
+
+string PsqlReplication::createSlot(void) noexcept(false){
+        static unsigned long  slotSeq   {0};
+
+        slotName           = "dbfs_" + to_string(getpid()) + "_" + to_string(slotSeq++);
+        string   cmdBuff   {"CREATE_REPLICATION_SLOT " + slotName + " TEMPORARY LOGICAL test_decoding EXPORT_SNAPSHOT"};
+        PGresult *result   {PQexec(conn, cmdBuff.c_str())};
+
+        if(PQresultStatus(result) != PGRES_TUPLES_OK || PQntuples(result) != 1 || PQnfields(result) < 3){
+                string errBuff {PQerrorMessage(conn)};
+                PQclear(result);
+                throw DbConnExc(string("Replication Slot Error: ").append(errBuff));
+        }
+
+        startPoint         = PQgetvalue(result, 0, 1);
+        string   snapshot  {PQgetvalue(result, 0, 2)};
+        PQclear(result);
+
+        lastReceived       = lastCommit = lastConfirmed = parseLsn(startPoint);
+
+        DBFS_LOG(syslog, LOG_INFO, {"- createSlot : slot: ", slotName, " - consistent point: ", startPoint, " - snapshot: ", snapshot});
+        return snapshot;
+}
+
+void PsqlReplication::start(void) noexcept(false){
+        string   cmdBuff   {"START_REPLICATION SLOT " + slotName + " LOGICAL " + startPoint};
+        PGresult *result   {PQexec(conn, cmdBuff.c_str())};
+
+        if(PQresultStatus(result) != PGRES_COPY_BOTH){
+                string errBuff {PQerrorMessage(conn)};
+                PQclear(result);
+                throw DbConnExc(string("Replication Start Error: ").append(errBuff));
+        }
+        PQclear(result);
+
+        started            = true;
+        lastStatus         = time(nullptr);
+}
+
+bool PsqlReplication::streaming(void) const noexcept(true){
+        return started;
+}
+
+void PsqlReplication::close(void) noexcept(true){
+        PQfinish(conn);
+        conn               = nullptr;
+        started            = false;
+        inTransaction      = false;
+        pending.clear();
+}
+
+uint64_t PsqlReplication::getInt64(const char* buf) noexcept(true){
+        uint64_t val {0};
+        for(int i = 0; i < 8; i++)
+                val = (val << 8) | static_cast<unsigned char>(buf[i]);
+        return val;
+}
+
+void PsqlReplication::putInt64(char* buf, uint64_t val) noexcept(true){
+        for(int i = 7; i >= 0; i--, val >>= 8)
+                buf[i] = static_cast<char>(val & 0xff);
+}
+
+uint64_t PsqlReplication::parseLsn(const string& lsn) noexcept(true){
+        size_t sep {lsn.find('/')};
+        if(sep == string::npos) return 0;
+
+        return (strtoull(lsn.substr(0, sep).c_str(), nullptr, 16) << 32) | 
+               strtoull(lsn.substr(sep + 1).c_str(), nullptr, 16);
+}
+
+void PsqlReplication::sendStatus(bool reply) noexcept(false){
+        char            buf[STATUS_LEN];
+        struct timeval  now;
+
+        gettimeofday(&now, nullptr);
+
+        buf[0]  = 'r';
+        putInt64(buf + 1,  max(lastReceived, lastCommit));
+        putInt64(buf + 9,  lastConfirmed);
+        putInt64(buf + 17, lastConfirmed);
+        putInt64(buf + 25, static_cast<uint64_t>(now.tv_sec - PG_EPOCH_OFFSET) * 1000000 + now.tv_usec);
+        buf[33] = reply ? 1 : 0;
+
+        if(PQputCopyData(conn, buf, STATUS_LEN) <= 0 || PQflush(conn) != 0)
+                throw DbConnExc(string("Replication Status Error: ").append(PQerrorMessage(conn)));
+
+        lastStatus = time(nullptr);
+}
+
+uint64_t PsqlReplication::committed(void) const noexcept(true){
+        return lastCommit;
+}
+
+// The server may drop the changes up to the position confirmed: never past the last commit received.
+void PsqlReplication::confirm(uint64_t lsn) noexcept(false){
+        lsn = min(lsn, lastCommit);
+        if(lsn <= lastConfirmed) return;
+
+        lastConfirmed = lsn;
+        sendStatus(false);
+}
+
+bool PsqlReplication::receive(Changes& changes, int timeoutMs) noexcept(false){
+        for(;;){
+             char *buf      {nullptr};
+             int  len       {PQgetCopyData(conn, &buf, 1)};
+
+             if(len == 0){
+                  if(time(nullptr) - lastStatus >= STATUS_SEC) sendStatus(false);
+
+                  struct pollfd  pfd  {PQsocket(conn), POLLIN, 0};
+                  int ret {poll(&pfd, 1, timeoutMs)};
+                  if(ret == -1 && errno != EINTR)
+                          throw DbConnExc(string("Replication Error: ").append(strerror(errno)));
+                  if(ret <= 0)
+                          return false;
+                  if(PQconsumeInput(conn) == 0)
+                          throw DbConnExc(string("Replication Error: ").append(PQerrorMessage(conn)));
+                  continue;
+             }
+             if(len == -1)
+                  throw DbConnExc("Replication Error: stream closed by the server.");
+             if(len < 0)
+                  throw DbConnExc(string("Replication Error: ").append(PQerrorMessage(conn)));
+
+             bool committed {false};
+
+             if(buf[0] == 'k' && len >= KEEPALIVE_LEN){
+                  if(!inTransaction)
+                          lastCommit = max(lastCommit, getInt64(buf + 1));
+                  if(buf[17] != 0) 
+                          sendStatus(false);
+             }else if(buf[0] == 'w' && len >= XLOGDATA_HDR){
+                  const char *data   {buf + XLOGDATA_HDR};
+                  size_t     dlen    {static_cast<size_t>(len - XLOGDATA_HDR)};
+                  uint64_t   start   {getInt64(buf + 1)};
+
+                  lastReceived = max(lastReceived, start);
+
+                  if(dlen >= 5 && strncmp(data, "BEGIN", 5) == 0){
+                          inTransaction = true;
+                          pending.clear();
+                  }else if(dlen >= 6 && strncmp(data, "COMMIT", 6) == 0){
+                          inTransaction = false;
+                          for(auto &pend : pending)
+                                  changes.push_back(move(pend));
+                          pending.clear();
+                          lastCommit    = max(lastCommit, start);
+                          committed     = true;
+                  }else if(!parseChange(data, dlen, pending)){
+                          DBFS_LOG(syslog, LOG_WARNING, {"- receive : unknown change: ", string(data, dlen)});
+                  }
+             }
+
+             PQfreemem(buf);
+             if(committed) return true;
+        }
+}
+
+bool PsqlReplication::parseIdent(const char*& pos, const char* end, string& ident) noexcept(false){
+        ident.clear();
+
+        if(pos < end && *pos == '"'){
+             ident.push_back(*pos++);
+             for( ; pos < end; pos++){
+                  ident.push_back(*pos);
+                  if(*pos == '"'){
+                       if(pos + 1 < end && pos[1] == '"'){
+                            ident.push_back(*++pos);
+                       }else{
+                            pos++;
+                            return true;
+                       }
+                  }
+             }
+             return false;
+        }
+
+        for( ; pos < end && *pos != '.' && *pos != ':' && *pos != '[' && *pos != ' ' && *pos != ','; pos++)
+             ident.push_back(*pos);
+
+        return ident.size() != 0;
+}
+
+bool PsqlReplication::parseTuple(const char*& pos, const char* end, Fields& tuple) noexcept(false){
+        const string  newTuple  {"new-tuple:"};
+
+        while(pos < end){
+             if(*pos == ' '){
+                  pos++;
+                  continue;
+             }
+             if(static_cast<size_t>(end - pos) >= newTuple.size() && newTuple.compare(0, newTuple.size(), pos, newTuple.size()) == 0)
+                  return true;
+
+             string      name,
+                         type,
+                         value;
+             FIELDSTATE  state     {FIELD_VALUE};
+             int         depth     {0};
+
+             if(!parseIdent(pos, end, name) || pos >= end || *pos != '[') return false;
+
+             for(const char *typeStart = pos + 1; pos < end; pos++){
+                  if(*pos == '['){
+                       depth++;
+                  }else if(*pos == ']' && --depth == 0){
+                       type.assign(typeStart, pos);
+                       break;
+                  }
+             }
+             if(pos >= end || ++pos >= end || *pos++ != ':') return false;
+
+             if(pos < end && (*pos == '\'' || (*pos == 'B' && pos + 1 < end && pos[1] == '\''))){
+                  if(*pos == 'B') pos++;
+                  for(pos++; pos < end; pos++){
+                       if(*pos == '\''){
+                            if(pos + 1 < end && pos[1] == '\'') 
+                                 value.push_back(*++pos);
+                            else
+                                 break;
+                       }else{
+                            value.push_back(*pos);
+                       }
+                  }
+                  if(pos >= end) return false;
+                  pos++;
+             }else{
+                  const char *valStart {pos};
+                  while(pos < end && *pos != ' ') pos++;
+                  value.assign(valStart, pos);
+
+                  if(value == "null"){
+                       state = FIELD_NULL;
+                       value.clear();
+                  }else if(value == "unchanged-toast-datum"){
+                       state = FIELD_UNCHANGED;
+                       value.clear();
+                  }else if(type == "boolean"){
+                       value = value == "true" ? "t" : "f";
+                  }
+             }
+
+             tuple.push_back(Field(name, value, state));
+        }
+
+        return true;
+}
+
+// A change of a row, or a TRUNCATE of one or more tables: "table a.b, c.d: TRUNCATE: ...".
+// A record of a table that can't be read further is a change of unknown kind: the table is reloaded.
+bool PsqlReplication::parseChange(const char* data, size_t len, Changes& changes) noexcept(false){
+        const char    *pos      {data},
+                      *end      {data + len};
+        const string  tablePfx  {"table "},
+                      oldKey    {"old-key: "},
+                      newTuple  {"new-tuple: "},
+                      noTuple   {"(no-tuple-data)"};
+        TableNames    tables;
+        string        qualName,
+                      part,
+                      operation;
+        bool          named     {false};
+
+        if(len < tablePfx.size() || tablePfx.compare(0, tablePfx.size(), pos, tablePfx.size()) != 0) return false;
+        pos += tablePfx.size();
+
+        for(;;){
+             named    = parseIdent(pos, end, part);
+             qualName = part;
+             while(named && pos < end && *pos == '.'){
+                  pos++;
+                  named = parseIdent(pos, end, part);
+                  qualName.append(".").append(part);
+             }
+             if(!named) break;
+
+             tables.push_back(qualName);
+             if(end - pos < 2 || pos[0] != ',' || pos[1] != ' ') break;
+             pos += 2;
+        }
+        if(tables.size() == 0) return false;
+
+        if(!named || end - pos < 2 || pos[0] != ':' || pos[1] != ' '){
+             for(auto &table : tables)
+                  changes.push_back(Change(table, CHANGE_UNKNOWN, Fields(), Fields()));
+             return true;
+        }
+        pos += 2;
+
+        while(pos < end && *pos != ':') operation.push_back(*pos++);
+        if(pos < end) pos++;
+        while(pos < end && *pos == ' ') pos++;
+
+        // Only a TRUNCATE names several tables.
+        if(tables.size() > 1 || operation == "TRUNCATE"){
+             for(auto &table : tables)
+                  changes.push_back(Change(table, operation == "TRUNCATE" ? CHANGE_TRUNCATE : CHANGE_UNKNOWN, Fields(), Fields()));
+             return true;
+        }
+
+        Change        change(tables[0], CHANGE_UNKNOWN, Fields(), Fields());
+
+        if(operation == "INSERT")        get<COP>(change) = CHANGE_INSERT;
+        else if(operation == "UPDATE")   get<COP>(change) = CHANGE_UPDATE;
+        else if(operation == "DELETE")   get<COP>(change) = CHANGE_DELETE;
+
+        // Without tuple data the row can't be addressed: the table must be reloaded.
+        if(static_cast<size_t>(end - pos) >= noTuple.size() && noTuple.compare(0, noTuple.size(), pos, noTuple.size()) == 0){
+             changes.push_back(Change(tables[0], CHANGE_UNKNOWN, Fields(), Fields()));
+             return true;
+        }
+
+        bool          parsed    {true};
+        switch(get<COP>(change)){
+             case CHANGE_INSERT:
+                  parsed = parseTuple(pos, end, get<CNEW>(change));
+             break;
+             case CHANGE_UPDATE:
+                  if(static_cast<size_t>(end - pos) >= oldKey.size() && oldKey.compare(0, oldKey.size(), pos, oldKey.size()) == 0){
+                       pos   += oldKey.size();
+                       parsed = parseTuple(pos, end, get<COLD>(change));
+                       if(parsed && static_cast<size_t>(end - pos) >= newTuple.size())
+                            pos += newTuple.size();
+                  }
+                  parsed = parsed && parseTuple(pos, end, get<CNEW>(change));
+             break;
+             case CHANGE_DELETE:
+                  parsed = parseTuple(pos, end, get<COLD>(change));
+             break;
+             case CHANGE_TRUNCATE:
+             case CHANGE_UNKNOWN:
+             default:
+             break;
+        }
+        if(!parsed){
+             get<COP>(change) = CHANGE_UNKNOWN;
+             get<COLD>(change).clear();
+             get<CNEW>(change).clear();
+        }
+        changes.push_back(move(change));
+
+        return true;
+}
+
+} // end namespace dbfsutils
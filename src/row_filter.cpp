@@ -0,0 +1,283 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <row_filter.hpp>
+
+using std::string;
+using std::vector;
+using std::thread;
+using std::min;
+using std::max;
+using std::exception_ptr;
+using std::current_exception;
+using std::rethrow_exception;
+using std::get;
+
+namespace dbfsutils{
+
+bool fieldValue(const char* row, const char* end, size_t field, bool escaped, 
+                const char*& value, size_t& len) noexcept(true){
+     // Every field is followed by ';': the field wanted starts after the separator of
+     // the one before. In COPY format a backslash escapes the character following it.
+     const char  *pos   {row};
+     for(size_t f = 0; f < field && pos < end; f++){
+          if(!escaped){
+               pos = static_cast<const char*>(memchr(pos, ';', end - pos));
+               if(pos == nullptr) return false;
+               pos++;
+               continue;
+          }
+          for(; pos < end && *pos != ';'; pos++)
+               if(*pos == '\\') pos++;
+          pos++;
+     }
+     if(pos >= end) return false;
+
+     const char  *stop  {pos};
+     if(!escaped)
+          stop = static_cast<const char*>(memchr(pos, ';', end - pos));
+     else
+          for(; stop < end && *stop != ';'; stop++)
+               if(*stop == '\\') stop++;
+     if(stop == nullptr || stop >= end) return false;
+
+     value = pos;
+     len   = static_cast<size_t>(stop - pos);
+     return true;
+}
+
+string copyEscape(const string& value) noexcept(false){
+     string  escaped;
+
+     // Like the text format of COPY, with ';' as delimiter.
+     escaped.reserve(value.size());
+     for(char chr : value){
+          char  escape  {'\0'};
+          switch(chr){
+               case '\\': escape = '\\'; break;
+               case ';':  escape = ';';  break;
+               case '\b': escape = 'b';  break;
+               case '\f': escape = 'f';  break;
+               case '\n': escape = 'n';  break;
+               case '\r': escape = 'r';  break;
+               case '\t': escape = 't';  break;
+               case '\v': escape = 'v';  break;
+               default:   escaped.push_back(chr); continue;
+          }
+          escaped.push_back('\\');
+          escaped.push_back(escape);
+     }
+
+     return escaped;
+}
+
+RowFilter::RowFilter(FILTERMODE mode, const string& pattern, size_t column, bool escaped)
+                     : filterMode{mode}, text{escaped ? copyEscape(pattern) : pattern}, field{column}, 
+                       escapes{escaped}{}
+
+bool RowFilter::escapedAt(const char* row, const char* pos) noexcept(true){
+     bool  escaped  {false};
+
+     for(; row < pos; row++)
+          escaped = !escaped && *row == '\\';
+     return escaped;
+}
+
+bool RowFilter::matchField(const char* row, const char* end) const noexcept(true){
+     const char  *value {nullptr};
+     size_t      len    {0};
+
+     return fieldValue(row, end, field, escapes, value, len) && len == text.size() && 
+            memcmp(value, text.data(), len) == 0;
+}
+
+void RowFilter::scan(const char* data, const RowIndex& index, RowNum first, RowNum last, Rows& rows) const noexcept(false){
+     size_t  pos   {index.start(first)},
+             end   {index.start(last)};
+
+     // An empty value can't be searched for: every row is a candidate.
+     if(text.size() == 0){
+          for(RowNum row = first; row < last; row++)
+               if(filterMode == FILTER_TEXT || matchField(data + index.start(row), data + index.start(row + 1)))
+                    rows.push_back(row);
+          return;
+     }
+
+     while(pos < end){
+          const void  *hit  {memmem(data + pos, end - pos, text.data(), text.size())};
+          if(hit == nullptr) break;
+
+          size_t  offset    {static_cast<size_t>(static_cast<const char*>(hit) - data)};
+          RowNum  row       {index.row(offset)};
+          size_t  rowStart  {index.start(row)},
+                  rowEnd    {index.start(row + 1)};
+
+          if(filterMode == FILTER_TEXT){
+               // A match crossing the end of the row belongs to no row, one starting inside 
+               // an escape, i.e. 'n' in '\n', to no value.
+               if(offset + text.size() > rowEnd || (escapes && escapedAt(data + rowStart, data + offset))){
+                    pos = offset + 1;
+                    continue;
+               }
+               rows.push_back(row);
+          }else if(matchField(data + rowStart, data + rowEnd)){
+               rows.push_back(row);
+          }
+          pos = rowEnd;
+     }
+}
+
+RowNum RowFilter::select(const char* data, const RowIndex& index, TableData& result) const noexcept(false){
+     RowNum                 total    {index.rows()};
+     size_t                 parts    {index.start(total) / PART_BYTES};
+     vector<thread>         threads;
+
+     parts = min<size_t>(parts, min<size_t>(PART_MAX, thread::hardware_concurrency()));
+     parts = max<size_t>(min<size_t>(parts, total), 1);
+
+     vector<Rows>           found(parts);
+     vector<exception_ptr>  failures(parts);
+
+     // The parts are split by rows, so every row is scanned by a single thread.
+     auto worker = [&](size_t part){
+             try{
+                 scan(data, index, total * part / parts, total * (part + 1) / parts, found[part]);
+             }catch(...){
+                 failures[part] = current_exception();
+             }
+     };
+
+     for(size_t part = 1; part < parts; part++)
+          threads.push_back(thread(worker, part));
+     worker(0);
+     for(auto &th : threads)
+          th.join();
+     for(auto &failure : failures)
+          if(failure) rethrow_exception(failure);
+
+     RowNum  selected  {0};
+     for(size_t part = 0; part < parts; part++){
+          for(RowNum row : found[part])
+               result.insert(result.end(), data + index.start(row), data + index.start(row + 1));
+          selected += found[part].size();
+     }
+
+     return selected;
+}
+
+const RowNum ValueIndex::NO_ROW;
+
+ValueIndex::ValueIndex(const string& columnName, size_t column, bool escaped)
+                     : colName{columnName}, field{column}, escapes{escaped}, used{0}{}
+
+void ValueIndex::build(const char* data, const RowIndex& index) noexcept(false){
+     RowNum      rows   {index.rows()};
+     size_t      size   {16};
+     while(size < rows * 2) size *= 2;
+
+     slots.assign(size, Slot(0, NO_ROW, NO_ROW));
+     next.assign(rows, NO_ROW);
+     used = 0;
+
+     for(RowNum row = 0; row < rows; row++){
+          const char  *value  {nullptr};
+          size_t      len     {0};
+          if(!fieldValue(data + index.start(row), data + index.start(row + 1), field, escapes, value, len)) continue;
+
+          uint64_t    hash    {NameIndex::hash(value, len)};
+          for(size_t pos = hash & (size - 1); ; pos = (pos + 1) & (size - 1)){
+               Slot   &slot   {slots[pos]};
+               if(get<SFIRST>(slot) == NO_ROW){
+                    slot = Slot(hash, row, row);
+                    used++;
+                    break;
+               }
+               if(get<SHASH>(slot) != hash) continue;
+
+               const char  *other     {nullptr};
+               size_t      otherLen   {0};
+               RowNum      first      {get<SFIRST>(slot)};
+               fieldValue(data + index.start(first), data + index.start(first + 1), field, escapes, other, otherLen);
+               if(otherLen != len || memcmp(other, value, len) != 0) continue;
+
+               next[get<SLAST>(slot)] = row;
+               get<SLAST>(slot)       = row;
+               break;
+          }
+     }
+}
+
+RowNum ValueIndex::find(const TableStore& store, const RowIndex& index, const string& value, TableData& result) const noexcept(false){
+     if(slots.size() == 0) return 0;
+
+     // A store not held in a single buffer is read a row at a time.
+     const char  *data    {store.contiguous()};
+     TableData   buffer;
+     auto rowBytes = [&](RowNum row, const char*& begin, const char*& end){
+             size_t  start  {index.start(row)},
+                     stop   {index.start(row + 1)};
+             if(data != nullptr){
+                 begin = data + start;
+                 end   = data + stop;
+                 return;
+             }
+             buffer.resize(stop - start);
+             buffer.resize(store.read(buffer.data(), buffer.size(), start));
+             begin = buffer.data();
+             end   = begin + buffer.size();
+     };
+
+     const string  key   {escapes ? copyEscape(value) : value};
+     uint64_t    hash    {NameIndex::hash(key.data(), key.size())};
+     size_t      mask    {slots.size() - 1};
+     for(size_t pos = hash & mask; get<SFIRST>(slots[pos]) != NO_ROW; pos = (pos + 1) & mask){
+          const Slot  &slot   {slots[pos]};
+          if(get<SHASH>(slot) != hash || get<SFIRST>(slot) >= index.rows()) continue;
+
+          const char  *begin  {nullptr},
+                      *end    {nullptr},
+                      *text   {nullptr};
+          size_t      len     {0};
+          rowBytes(get<SFIRST>(slot), begin, end);
+          if(!fieldValue(begin, end, field, escapes, text, len) || len != key.size() || 
+             memcmp(text, key.data(), len) != 0) continue;
+
+          RowNum      found   {0};
+          for(RowNum row = get<SFIRST>(slot); row != NO_ROW && row < index.rows(); row = next[row]){
+               rowBytes(row, begin, end);
+               result.insert(result.end(), begin, end);
+               found++;
+          }
+          return found;
+     }
+
+     return 0;
+}
+
+const string& ValueIndex::name(void) const noexcept(true){
+     return colName;
+}
+
+size_t ValueIndex::values(void) const noexcept(true){
+     return used;
+}
+
+size_t ValueIndex::memory(void) const noexcept(true){
+     return slots.capacity() * sizeof(Slot) + next.capacity() * sizeof(RowNum);
+}
+
+} // end namespace dbfsutils
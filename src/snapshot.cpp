@@ -0,0 +1,209 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <snapshot.hpp>
+
+using std::string;
+using std::get;
+using std::move;
+using std::min;
+using std::vector;
+using std::to_string;
+using std::shared_ptr;
+using std::make_shared;
+using std::runtime_error;
+
+using syslogwrp::Syslog; 
+
+namespace dbfsutils{
+
+const char   Snapshot::MAGIC[8]   {'D', 'B', 'F', 'S', 'S', 'N', 'A', 'P'};
+
+size_t Snapshot::aligned(size_t len) noexcept(true){
+     return (len + ALIGN - 1) & ~static_cast<size_t>(ALIGN - 1);
+}
+
+// Every part of the file is padded to ALIGN: a part fits when its padded length is inside the file.
+bool Snapshot::fits(size_t pos, uint64_t len, size_t length) noexcept(true){
+     return pos <= length && len <= length - pos && aligned(len) <= length - pos;
+}
+
+void Snapshot::writeAll(int fd, const char* buf, size_t len, uint64_t& written) noexcept(false){
+     for(size_t done = 0; done < len; ){
+          ssize_t ret {write(fd, buf + done, len - done)};
+          if(ret == -1){
+               if(errno == EINTR) continue;
+               throw runtime_error(string("Snapshot write error: ").append(strerror(errno)));
+          }
+          done += ret;
+     }
+     written += len;
+}
+
+void Snapshot::padAll(int fd, uint64_t& written) noexcept(false){
+     const char   pad[ALIGN]  {};
+
+     writeAll(fd, pad, aligned(written) - written, written);
+}
+
+void Snapshot::save(const string& path, const TableList& db, Syslog *slog) noexcept(false){
+     const string   tmpPath   {path + ".tmp"};
+     Header         header    {};
+     uint64_t       written   {0};
+     TableData      buffer(WRITE_BUFF);
+     int            fd        {open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600)};
+
+     if(fd == -1)
+          throw runtime_error(string("Snapshot open error: ").append(strerror(errno)));
+
+     try{
+          std::copy(MAGIC, MAGIC + sizeof(MAGIC), header.magic);
+          header.format = FORMAT;
+          for(auto &table : db)
+               if(get<DATA>(table.second)) header.tables++;
+          writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header), written);
+          padAll(fd, written);
+
+          // Tables not loaded yet (lazy mode) are left out: they are listed again by the refresh.
+          for(auto &table : db){
+               const StorePtr &store  {get<DATA>(table.second)};
+               if(!store) continue;
+
+               Entry    entry  {};
+               entry.nameLen    = table.first.size();
+               entry.versionLen = get<VERS>(table.second).size();
+               entry.rows       = get<RNUM>(table.second);
+               entry.size       = store->size();
+               entry.stat       = get<SSTAT>(table.second);
+               entry.loaded     = entry.stat.st_ctim.tv_sec;
+               entry.offset     = written + aligned(sizeof(entry)) + aligned(entry.nameLen) + aligned(entry.versionLen);
+
+               writeAll(fd, reinterpret_cast<const char*>(&entry), sizeof(entry), written);
+               padAll(fd, written);
+               writeAll(fd, table.first.data(), entry.nameLen, written);
+               padAll(fd, written);
+               writeAll(fd, get<VERS>(table.second).data(), entry.versionLen, written);
+               padAll(fd, written);
+
+               for(size_t offset = 0; offset < entry.size; ){
+                    size_t count {store->read(buffer.data(), min(buffer.size(), entry.size - offset), offset)};
+                    if(count == 0) 
+                         throw runtime_error("Snapshot write error: table changed while saving: " + table.first);
+                    writeAll(fd, buffer.data(), count, written);
+                    offset  += count;
+               }
+               padAll(fd, written);
+          }
+
+          header.length = written;
+          if(pwrite(fd, &header, sizeof(header), 0) != sizeof(header) || fsync(fd) == -1)
+               throw runtime_error(string("Snapshot write error: ").append(strerror(errno)));
+     }catch(...){
+          close(fd);
+          unlink(tmpPath.c_str());
+          throw;
+     }
+
+     close(fd);
+     if(rename(tmpPath.c_str(), path.c_str()) == -1){
+          unlink(tmpPath.c_str());
+          throw runtime_error(string("Snapshot rename error: ").append(strerror(errno)));
+     }
+
+     DBFS_LOG(slog, LOG_INFO, {"- Snapshot::save : tables: ", to_string(header.tables), " - bytes: ", to_string(written), " - file: ", path});
+}
+
+bool Snapshot::restore(const string& path, TableList& db, Syslog *slog) noexcept(false){
+     struct stat  fileStat;
+     int          fd        {open(path.c_str(), O_RDONLY)};
+
+     if(fd == -1){
+          DBFS_LOG(slog, LOG_INFO, {"- Snapshot::restore : no snapshot: ", path, " - ", strerror(errno)});
+          return false;
+     }
+     if(fstat(fd, &fileStat) == -1 || static_cast<size_t>(fileStat.st_size) < sizeof(Header)){
+          close(fd);
+          DBFS_LOG(slog, LOG_WARNING, {"- Snapshot::restore : invalid snapshot: ", path});
+          return false;
+     }
+
+     size_t   length  {static_cast<size_t>(fileStat.st_size)};
+     void     *addr   {mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0)};
+     if(addr == MAP_FAILED){
+          close(fd);
+          DBFS_LOG(slog, LOG_WARNING, {"- Snapshot::restore : mmap error: ", strerror(errno)});
+          return false;
+     }
+
+     // The descriptor stays open with the mapping: reads can be spliced from the file.
+     shared_ptr<const MappedFile>  mapped  {make_shared<MappedFile>(addr, length, fd)};
+     const char                    *base   {mapped->data()};
+     Header                        header;
+     TableList                     restored;
+     size_t                        pos     {aligned(sizeof(Header))};
+
+     std::copy(base, base + sizeof(header), reinterpret_cast<char*>(&header));
+     if(!std::equal(MAGIC, MAGIC + sizeof(MAGIC), header.magic) || header.format != FORMAT || header.length != length){
+          DBFS_LOG(slog, LOG_WARNING, {"- Snapshot::restore : invalid or truncated snapshot: ", path});
+          return false;
+     }
+
+     // Every offset and length is checked against the file before it's used: pos never passes its end.
+     for(uint32_t t = 0; t < header.tables; t++){
+          Entry  entry;
+
+          if(!fits(pos, sizeof(entry), length)) break;
+          std::copy(base + pos, base + pos + sizeof(entry), reinterpret_cast<char*>(&entry));
+          pos += aligned(sizeof(entry));
+
+          if(!fits(pos, entry.nameLen, length)) break;
+          TableName     name    {base + pos, entry.nameLen};
+          pos += aligned(entry.nameLen);
+
+          if(!fits(pos, entry.versionLen, length)) break;
+          TableVersion  version {base + pos, entry.versionLen};
+          pos += aligned(entry.versionLen);
+
+          // Every row ends with a new line: a table can't have more rows than bytes.
+          if(entry.offset != pos || !fits(pos, entry.size, length) || entry.rows > entry.size) break;
+          pos += aligned(entry.size);
+
+          TableAttr &tableAttr {restored[name]};
+          get<RNUM>(tableAttr)          = entry.rows;
+          get<DATA>(tableAttr)          = make_shared<MappedStore>(mapped, entry.offset, entry.size, entry.rows);
+          get<SSTAT>(tableAttr)         = entry.stat;
+          get<SSTAT>(tableAttr).st_uid  = getuid();
+          get<SSTAT>(tableAttr).st_gid  = getgid();
+          get<VERS>(tableAttr)          = version;
+
+          DBFS_LOG(slog, LOG_DEBUG, {"- Snapshot::restore : table: ", name, " - bytes: ", to_string(entry.size), 
+                                     " - loaded at: ", to_string(entry.loaded)});
+     }
+
+     if(restored.size() != header.tables || pos != length){
+          DBFS_LOG(slog, LOG_WARNING, {"- Snapshot::restore : corrupted snapshot: ", path});
+          return false;
+     }
+
+     for(auto &table : restored)
+          db[table.first] = move(table.second);
+
+     DBFS_LOG(slog, LOG_INFO, {"- Snapshot::restore : tables: ", to_string(header.tables), " - bytes: ", to_string(length), " - file: ", path});
+     return true;
+}
+
+} // end namespace dbfsutils
@@ -19,14 +19,24 @@
 
 using std::initializer_list;
 using std::string;
+using std::thread;
+using std::min;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
 
 namespace syslogwrp{
 
-    Syslog::Syslog(string ident, int opts, int facility){
+    Syslog::Syslog(string ident, int opts, int facility)
+                 : priority{LOG_UPTO(LOG_DEBUG)}, previousPriority{LOG_UPTO(LOG_DEBUG)}, ring{new Slot[RING_SLOTS]}, 
+                   enqueuePos{0}, dequeuePos{0}, running{false}, dropped{0}{
+            for(size_t i = 0; i < RING_SLOTS; i++)
+                ring[i].sequence.store(i, memory_order_relaxed);
             openlog(ident.c_str(), opts, facility);
     }
     
     Syslog::~Syslog(void){
+            stopAsync();
             closelog();
     }
     
@@ -44,13 +54,82 @@ namespace syslogwrp{
     }
     
     void Syslog::log(int msgPriority, const char* msg) const noexcept(true){
-            syslog(msgPriority, "%s", msg);
+            emit(msgPriority, msg, strlen(msg));
     }
 
     void Syslog::log(int msgPriority,  initializer_list<string> arguments) const noexcept(true){
             string body;
-            for(string arg : arguments ) body.append(arg);
-            syslog(msgPriority, "%s",  body.c_str());
+            for(const string& arg : arguments ) body.append(arg);
+            emit(msgPriority, body.c_str(), body.size());
+    }
+
+    void Syslog::emit(int msgPriority, const char* msg, size_t len) const noexcept(true){
+            if(!running.load(memory_order_acquire)){
+                syslog(msgPriority, "%.*s", static_cast<int>(len), msg);
+                return;
+            }
+
+            // Bounded multi-producer queue: a slot is free for the position pos when its sequence is pos,
+            // and ready for the writer when it's pos + 1.
+            size_t  pos  {enqueuePos.load(memory_order_relaxed)};
+            Slot    *slot;
+            for(;;){
+                slot                = &ring[pos & (RING_SLOTS - 1)];
+                size_t    seq       {slot->sequence.load(memory_order_acquire)};
+                intptr_t  diff      {static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos)};
+
+                if(diff == 0){
+                    if(enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+                }else if(diff < 0){
+                    dropped.fetch_add(1, memory_order_relaxed);
+                    return;
+                }else{
+                    pos = enqueuePos.load(memory_order_relaxed);
+                }
+            }
+
+            slot->priority = msgPriority;
+            slot->length   = min(len, static_cast<size_t>(MSG_LEN));
+            memcpy(slot->text, msg, slot->length);
+            slot->sequence.store(pos + 1, memory_order_release);
+    }
+
+    bool Syslog::drain(void) noexcept(true){
+            bool   written  {false};
+
+            for(;;){
+                Slot    &slot  {ring[dequeuePos & (RING_SLOTS - 1)]};
+                if(slot.sequence.load(memory_order_acquire) != dequeuePos + 1) break;
+
+                syslog(slot.priority, "%.*s", static_cast<int>(slot.length), slot.text);
+                slot.sequence.store(dequeuePos + RING_SLOTS, memory_order_release);
+                dequeuePos++;
+                written = true;
+            }
+
+            return written;
+    }
+
+    void Syslog::writeLoop(void) noexcept(true){
+            while(running.load(memory_order_acquire))
+                if(!drain()) usleep(IDLE_MS * 1000);
+            drain();
+    }
+
+    void Syslog::startAsync(void) noexcept(false){
+            if(running.exchange(true)) return;
+            writer = thread(&Syslog::writeLoop, this);
+    }
+
+    void Syslog::stopAsync(void) noexcept(true){
+            if(!running.exchange(false)) return;
+            if(writer.joinable()) writer.join();
+
+            // Messages queued by a producer racing with the stop.
+            drain();
+            unsigned long lost {dropped.exchange(0)};
+            if(lost != 0)
+                syslog(LOG_WARNING, "- Syslog : messages dropped, ring full: %lu", lost);
     }
 
 
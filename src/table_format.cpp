@@ -0,0 +1,252 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <table_format.hpp>
+
+using std::string;
+using std::vector;
+using std::get;
+using std::istringstream;
+using std::getline;
+
+namespace dbfsutils{
+
+TableFormat::TableFormat(OUTFORMAT format, const ColumnNames& columnNames, bool escaped, bool header,
+                         const ColumnTypes& columnTypes)
+                     : outFormat{format}, names{columnNames}, types{columnTypes}, escapes{escaped}, 
+                       withHeader{header}{}
+
+bool TableFormat::parse(const string& list, OutFormats& formats, bool& header) noexcept(false){
+     istringstream  items(list);
+     string         item;
+
+     formats.clear();
+     header = false;
+     while(getline(items, item, ',')){
+          if(item == "csv")        formats.push_back(FORMAT_CSV);
+          else if(item == "tsv")   formats.push_back(FORMAT_TSV);
+          else if(item == "jsonl") formats.push_back(FORMAT_JSONL);
+          else if(item == "arrow") formats.push_back(FORMAT_ARROW);
+          else if(item == "header") header = true;
+          else return false;
+     }
+
+     return formats.size() != 0;
+}
+
+const char* TableFormat::extension(OUTFORMAT format) noexcept(true){
+     switch(format){
+          case FORMAT_CSV:   return "csv";
+          case FORMAT_TSV:   return "tsv";
+          case FORMAT_ARROW: return "arrow";
+          case FORMAT_JSONL: 
+          default:           return "jsonl";
+     }
+}
+
+void TableFormat::unescape(const char* text, size_t len, string& value) noexcept(false){
+     value.clear();
+     for(size_t i = 0; i < len; i++){
+          if(text[i] != '\\' || i + 1 == len){
+               value.push_back(text[i]);
+               continue;
+          }
+          switch(text[++i]){
+               case 'b':  value.push_back('\b'); break;
+               case 'f':  value.push_back('\f'); break;
+               case 'n':  value.push_back('\n'); break;
+               case 'r':  value.push_back('\r'); break;
+               case 't':  value.push_back('\t'); break;
+               case 'v':  value.push_back('\v'); break;
+               default:   value.push_back(text[i]);
+          }
+     }
+}
+
+void TableFormat::putCsv(const char* text, size_t len, TableData& out) noexcept(false){
+     bool  quote  {false};
+     for(size_t i = 0; i < len && !quote; i++)
+          quote = text[i] == ',' || text[i] == '"' || text[i] == '\r' || text[i] == '\n';
+
+     if(!quote){
+          out.insert(out.end(), text, text + len);
+          return;
+     }
+
+     out.push_back('"');
+     for(size_t i = 0; i < len; i++){
+          if(text[i] == '"') out.push_back('"');
+          out.push_back(text[i]);
+     }
+     out.push_back('"');
+}
+
+void TableFormat::putTsv(const char* text, size_t len, TableData& out) noexcept(false){
+     for(size_t i = 0; i < len; i++){
+          char  escape  {'\0'};
+          switch(text[i]){
+               case '\\': escape = '\\'; break;
+               case '\t': escape = 't';  break;
+               case '\n': escape = 'n';  break;
+               case '\r': escape = 'r';  break;
+               default:   out.push_back(text[i]); continue;
+          }
+          out.push_back('\\');
+          out.push_back(escape);
+     }
+}
+
+void TableFormat::putJson(const char* text, size_t len, TableData& out) noexcept(false){
+     const char  hex[] {"0123456789abcdef"};
+
+     // The bytes from 0x80 are copied: the text is expected in UTF-8, as sent by the server.
+     out.push_back('"');
+     for(size_t i = 0; i < len; i++){
+          unsigned char  chr     {static_cast<unsigned char>(text[i])};
+          char           escape  {'\0'};
+          switch(chr){
+               case '"':  escape = '"';  break;
+               case '\\': escape = '\\'; break;
+               case '\b': escape = 'b';  break;
+               case '\f': escape = 'f';  break;
+               case '\n': escape = 'n';  break;
+               case '\r': escape = 'r';  break;
+               case '\t': escape = 't';  break;
+               default:
+                    if(chr >= 0x20){
+                         out.push_back(text[i]);
+                         continue;
+                    }
+                    const char  code[] {'\\', 'u', '0', '0', hex[chr >> 4], hex[chr & 0x0f]};
+                    out.insert(out.end(), code, code + sizeof(code));
+                    continue;
+          }
+          out.push_back('\\');
+          out.push_back(escape);
+     }
+     out.push_back('"');
+}
+
+void TableFormat::putValue(const char* text, size_t len, TableData& out) const noexcept(false){
+     switch(outFormat){
+          case FORMAT_CSV:   putCsv(text, len, out);  break;
+          case FORMAT_TSV:   putTsv(text, len, out);  break;
+          case FORMAT_JSONL: putJson(text, len, out); break;
+          case FORMAT_ARROW: break;
+     }
+}
+
+void TableFormat::putRow(const vector<Value>& fields, TableData& out) const noexcept(false){
+     string  value;
+
+     if(outFormat == FORMAT_JSONL) out.push_back('{');
+     for(size_t f = 0; f < fields.size(); f++){
+          if(f != 0) out.push_back(outFormat == FORMAT_TSV ? '\t' : ',');
+          if(outFormat == FORMAT_JSONL){
+               putJson(names[f].data(), names[f].size(), out);
+               out.push_back(':');
+          }
+          if(!escapes || memchr(get<VTEXT>(fields[f]), '\\', get<VLEN>(fields[f])) == nullptr){
+               putValue(get<VTEXT>(fields[f]), get<VLEN>(fields[f]), out);
+               continue;
+          }
+          unescape(get<VTEXT>(fields[f]), get<VLEN>(fields[f]), value);
+          putValue(value.data(), value.size(), out);
+     }
+     if(outFormat == FORMAT_JSONL) out.push_back('}');
+     if(outFormat == FORMAT_CSV)   out.push_back('\r');
+     out.push_back('\n');
+}
+
+bool TableFormat::nextRow(const char*& pos, const char* end, vector<Value>& fields) const noexcept(true){
+     // A row ends at the new line after the separator of its last field: a new line 
+     // inside a value, in the rows loaded with SELECT, doesn't end it.
+     for(size_t f = 0; f < fields.size(); f++){
+          const char  *sep  {pos};
+          if(!escapes)
+               sep = static_cast<const char*>(memchr(pos, ';', end - pos));
+          else
+               for(; sep < end && *sep != ';'; sep++)
+                    if(*sep == '\\') sep++;
+          if(sep == nullptr || sep >= end) return false;
+
+          fields[f] = Value(pos, static_cast<size_t>(sep - pos));
+          pos       = sep + 1;
+     }
+     if(pos < end && *pos == '\n'){
+          pos++;
+     }else{
+          const char  *line  {static_cast<const char*>(memchr(pos, '\n', end - pos))};
+          pos = line != nullptr ? line + 1 : end;
+     }
+
+     return true;
+}
+
+RowNum TableFormat::renderArrow(const char* data, size_t len, TableData& out) const noexcept(false){
+     const char     *pos    {data},
+                    *end    {data + len};
+     vector<Value>  fields(names.size());
+     ArrowWriter    writer(names, types);
+     RowNum         rows    {0};
+     string         value;
+
+     // The whole table is a single record batch, written once every row is read.
+     while(pos < end && nextRow(pos, end, fields)){
+          for(size_t f = 0; f < fields.size(); f++){
+               if(!escapes || memchr(get<VTEXT>(fields[f]), '\\', get<VLEN>(fields[f])) == nullptr){
+                    writer.append(f, get<VTEXT>(fields[f]), get<VLEN>(fields[f]));
+                    continue;
+               }
+               unescape(get<VTEXT>(fields[f]), get<VLEN>(fields[f]), value);
+               writer.append(f, value.data(), value.size());
+          }
+          writer.endRow();
+          rows++;
+     }
+
+     writer.write(out);
+     return rows;
+}
+
+RowNum TableFormat::render(const char* data, size_t len, TableData& out) const noexcept(false){
+     const char     *pos    {data},
+                    *end    {data + len};
+     vector<Value>  fields(names.size());
+     RowNum         rows    {0};
+
+     if(outFormat == FORMAT_ARROW) return renderArrow(data, len, out);
+
+     out.reserve(out.size() + len + len / 4);
+     if(withHeader && outFormat != FORMAT_JSONL){
+          for(size_t f = 0; f < names.size(); f++){
+               if(f != 0) out.push_back(outFormat == FORMAT_TSV ? '\t' : ',');
+               putValue(names[f].data(), names[f].size(), out);
+          }
+          if(outFormat == FORMAT_CSV) out.push_back('\r');
+          out.push_back('\n');
+     }
+
+     while(pos < end && nextRow(pos, end, fields)){
+          putRow(fields, out);
+          rows++;
+     }
+
+     return rows;
+}
+
+} // end namespace dbfsutils
@@ -0,0 +1,587 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+#include <table_store.hpp>
+
+using std::string;
+using std::vector;
+using std::get;
+using std::min;
+using std::upper_bound;
+using std::move;
+using std::to_string;
+using std::mutex;
+using std::lock_guard;
+using std::runtime_error;
+using std::shared_ptr;
+
+namespace dbfsutils{
+
+TableStore::TableStore(void)
+                     : lastAccess{0}{}
+
+TableStore::~TableStore(){}
+
+void TableStore::touch(unsigned long tick) const noexcept(true){
+     lastAccess.store(tick, std::memory_order_relaxed);
+}
+
+unsigned long TableStore::accessed(void) const noexcept(true){
+     return lastAccess.load(std::memory_order_relaxed);
+}
+
+const char* TableStore::contiguous(void) const noexcept(true){
+     return nullptr;
+}
+
+int TableStore::descriptor(size_t& position) const noexcept(true){
+     position = 0;
+     return -1;
+}
+
+FlatStore::FlatStore(TableData&& tdata, RowNum rnum)
+                     : data{move(tdata)}, rowNum{rnum}{}
+
+size_t FlatStore::size(void) const noexcept(true){
+     return data.size();
+}
+
+RowNum FlatStore::rows(void) const noexcept(true){
+     return rowNum;
+}
+
+size_t FlatStore::read(char* buf, size_t len, size_t offset) const noexcept(false){
+     if(offset >= data.size()) return 0;
+
+     size_t count {min(len, data.size() - offset)};
+     std::copy(data.data() + offset, data.data() + offset + count, buf);
+     return count;
+}
+
+size_t FlatStore::memory(void) const noexcept(true){
+     return data.capacity();
+}
+
+const char* FlatStore::contiguous(void) const noexcept(true){
+     return data.data();
+}
+
+MappedFile::MappedFile(void* address, size_t length, int fd)
+                     : addr{address}, len{length}, fileDesc{fd}{}
+
+MappedFile::~MappedFile(){
+     munmap(addr, len);
+     if(fileDesc != -1) close(fileDesc);
+}
+
+int MappedFile::descriptor(void) const noexcept(true){
+     return fileDesc;
+}
+
+#ifdef SYS_memfd_create
+
+shared_ptr<const MappedFile> MappedFile::fromData(const TableData& tdata) noexcept(false){
+     if(tdata.size() == 0) 
+          throw runtime_error("MappedFile: empty data");
+
+     int  fd  {static_cast<int>(syscall(SYS_memfd_create, "dbfs", MFD_CLOEXEC))};
+     if(fd == -1) 
+          throw runtime_error(string("MappedFile: memfd_create: ").append(strerror(errno)));
+
+     for(size_t done = 0; done < tdata.size(); ){
+          ssize_t  ret  {write(fd, tdata.data() + done, tdata.size() - done)};
+          if(ret == -1 && errno == EINTR) continue;
+          if(ret == -1){
+               string errBuff {strerror(errno)};
+               close(fd);
+               throw runtime_error("MappedFile: write: " + errBuff);
+          }
+          done += static_cast<size_t>(ret);
+     }
+
+     void  *addr  {mmap(nullptr, tdata.size(), PROT_READ, MAP_SHARED, fd, 0)};
+     if(addr == MAP_FAILED){
+          string errBuff {strerror(errno)};
+          close(fd);
+          throw runtime_error("MappedFile: mmap: " + errBuff);
+     }
+
+     return std::make_shared<const MappedFile>(addr, tdata.size(), fd);
+}
+
+#endif
+
+const char* MappedFile::data(void) const noexcept(true){
+     return static_cast<const char*>(addr);
+}
+
+size_t MappedFile::size(void) const noexcept(true){
+     return len;
+}
+
+MappedStore::MappedStore(shared_ptr<const MappedFile> mapped, size_t offset, size_t length, RowNum rnum, bool resident)
+                     : file{mapped}, data{mapped->data() + offset}, total{length}, rowNum{rnum}, inMemory{resident}{}
+
+size_t MappedStore::size(void) const noexcept(true){
+     return total;
+}
+
+RowNum MappedStore::rows(void) const noexcept(true){
+     return rowNum;
+}
+
+size_t MappedStore::memory(void) const noexcept(true){
+     return inMemory ? total : 0;
+}
+
+const char* MappedStore::contiguous(void) const noexcept(true){
+     return data;
+}
+
+int MappedStore::descriptor(size_t& position) const noexcept(true){
+     position = data - file->data();
+     return file->descriptor();
+}
+
+size_t MappedStore::read(char* buf, size_t len, size_t offset) const noexcept(false){
+     if(offset >= total) return 0;
+
+     size_t count {min(len, total - offset)};
+     std::copy(data + offset, data + offset + count, buf);
+     return count;
+}
+
+RangeStore::RangeStore(shared_ptr<TableStore> base, size_t offset, size_t length, RowNum rnum)
+                     : store{base}, start{offset}, total{length}, rowNum{rnum}{}
+
+size_t RangeStore::size(void) const noexcept(true){
+     return total;
+}
+
+RowNum RangeStore::rows(void) const noexcept(true){
+     return rowNum;
+}
+
+size_t RangeStore::memory(void) const noexcept(true){
+     return 0;
+}
+
+const char* RangeStore::contiguous(void) const noexcept(true){
+     const char *data {store->contiguous()};
+     return data != nullptr ? data + start : nullptr;
+}
+
+int RangeStore::descriptor(size_t& position) const noexcept(true){
+     int fd {store->descriptor(position)};
+     position += start;
+     return fd;
+}
+
+size_t RangeStore::read(char* buf, size_t len, size_t offset) const noexcept(false){
+     if(offset >= total) return 0;
+
+     return store->read(buf, min(len, total - offset), start + offset);
+}
+
+void RowIndex::push(size_t end) noexcept(false){
+     if(wide.size() == 0 && end <= std::numeric_limits<uint32_t>::max()){
+          narrow.push_back(static_cast<uint32_t>(end));
+          return;
+     }
+     if(narrow.size() != 0){
+          wide.assign(narrow.begin(), narrow.end());
+          vector<uint32_t>().swap(narrow);
+     }
+     wide.push_back(end);
+}
+
+void RowIndex::append(const RowIndex& other, size_t shift) noexcept(false){
+     for(RowNum row = 0; row < other.rows(); row++)
+          push(other.start(row + 1) + shift);
+}
+
+RowNum RowIndex::rows(void) const noexcept(true){
+     return narrow.size() + wide.size();
+}
+
+size_t RowIndex::start(RowNum row) const noexcept(true){
+     if(row == 0) return 0;
+     return wide.size() != 0 ? wide[row - 1] : narrow[row - 1];
+}
+
+RowNum RowIndex::row(size_t offset) const noexcept(true){
+     if(wide.size() != 0)
+          return static_cast<RowNum>(upper_bound(wide.begin(), wide.end(), offset) - wide.begin());
+     return static_cast<RowNum>(upper_bound(narrow.begin(), narrow.end(), offset) - narrow.begin());
+}
+
+size_t RowIndex::memory(void) const noexcept(true){
+     return narrow.capacity() * sizeof(uint32_t) + wide.capacity() * sizeof(uint64_t);
+}
+
+#ifdef HAVE_LIBLZ4
+
+BlockStore::BlockStore(TableData&& tdata, RowNum rnum, size_t blockLen)
+                     : total{tdata.size()}, blockSize{blockLen}, rowNum{rnum}, tick{0}{
+     TableData  raw       {move(tdata)};
+     TableData  buffer(LZ4_compressBound(static_cast<int>(blockSize)));
+
+     offsets.push_back(0);
+     for(size_t start = 0; start < total; start += blockSize){
+          int  rawLen   {static_cast<int>(min(blockSize, total - start))},
+               packLen  {LZ4_compress_default(raw.data() + start, buffer.data(), rawLen, static_cast<int>(buffer.size()))};
+
+          // Incompressible block: it's stored as it is, recognized by its length.
+          if(packLen <= 0 || packLen >= rawLen)
+               packed.insert(packed.end(), raw.data() + start, raw.data() + start + rawLen);
+          else
+               packed.insert(packed.end(), buffer.data(), buffer.data() + packLen);
+          offsets.push_back(packed.size());
+     }
+     packed.shrink_to_fit();
+}
+
+size_t BlockStore::size(void) const noexcept(true){
+     return total;
+}
+
+RowNum BlockStore::rows(void) const noexcept(true){
+     return rowNum;
+}
+
+size_t BlockStore::memory(void) const noexcept(true){
+     lock_guard<mutex> lock(mtxCache);
+
+     size_t bytes {packed.capacity() + offsets.capacity() * sizeof(size_t)};
+     for(auto &cached : cache)
+          bytes += get<CDATA>(cached).capacity();
+     return bytes;
+}
+
+const char* BlockStore::block(size_t index) const noexcept(false){
+     size_t  rawLen   {min(blockSize, total - index * blockSize)},
+             packLen  {offsets[index + 1] - offsets[index]};
+
+     if(packLen == rawLen)
+          return packed.data() + offsets[index];
+
+     tick++;
+     for(auto &cached : cache){
+          if(get<CBLOCK>(cached) == index){
+               get<CTICK>(cached) = tick;
+               return get<CDATA>(cached).data();
+          }
+     }
+
+     size_t victim {0};
+     if(cache.size() < BLOCK_CACHE){
+          victim = cache.size();
+          cache.push_back(CachedBlock(index, tick, TableData(blockSize)));
+     }else{
+          for(size_t c = 1; c < cache.size(); c++)
+               if(get<CTICK>(cache[c]) < get<CTICK>(cache[victim])) victim = c;
+          get<CBLOCK>(cache[victim]) = index;
+          get<CTICK>(cache[victim])  = tick;
+     }
+
+     CachedBlock &cached {cache[victim]};
+     if(LZ4_decompress_safe(packed.data() + offsets[index], get<CDATA>(cached).data(), 
+                            static_cast<int>(packLen), static_cast<int>(blockSize)) != static_cast<int>(rawLen)){
+          get<CBLOCK>(cached) = total;
+          throw runtime_error("BlockStore: corrupted block " + to_string(index));
+     }
+     return get<CDATA>(cached).data();
+}
+
+size_t BlockStore::read(char* buf, size_t len, size_t offset) const noexcept(false){
+     lock_guard<mutex> lock(mtxCache);
+
+     if(offset >= total) return 0;
+
+     size_t count  {min(len, total - offset)},
+            done   {0};
+
+     while(done < count){
+          size_t  index   {(offset + done) / blockSize},
+                  intra   {(offset + done) % blockSize},
+                  chunk   {min(count - done, min(blockSize, total - index * blockSize) - intra)};
+          const char *data {block(index)};
+
+          std::copy(data + intra, data + intra + chunk, buf + done);
+          done += chunk;
+     }
+     return count;
+}
+
+#endif
+
+RowStore::RowStore(const string& qualifiedName, const ColumnNames& columnNames, const vector<bool>& keyColumns,
+                   const ColumnTypes& columnTypes)
+                     : qualName{qualifiedName}, columns{columnNames}, keys{keyColumns}, colTypes{columnTypes},
+                       fenwick(1, 0), total{0}, rowNum{0}{}
+
+size_t RowStore::size(void) const noexcept(true){
+     lock_guard<mutex> lock(mtxRows);
+     return total;
+}
+
+RowNum RowStore::rows(void) const noexcept(true){
+     lock_guard<mutex> lock(mtxRows);
+     return rowNum;
+}
+
+const string& RowStore::qualified(void) const noexcept(true){
+     return qualName;
+}
+
+const ColumnNames& RowStore::names(void) const noexcept(true){
+     return columns;
+}
+
+const ColumnTypes& RowStore::types(void) const noexcept(true){
+     return colTypes;
+}
+
+void RowStore::rowIndex(RowIndex& index) const noexcept(false){
+     lock_guard<mutex> lock(mtxRows);
+
+     size_t  end  {0};
+     for(auto &row : slots){
+          if(get<RTEXT>(row).size() == 0) continue;
+          end += get<RTEXT>(row).size();
+          index.push(end);
+     }
+}
+
+void RowStore::columnData(ColumnData& cdata) const noexcept(false){
+     lock_guard<mutex> lock(mtxRows);
+
+     cdata.assign(columns.size(), TableData());
+     for(auto &row : slots){
+          const string&           text  {get<RTEXT>(row)};
+          const vector<uint32_t>& ends  {get<RENDS>(row)};
+          if(text.size() == 0) continue;
+
+          for(size_t c = 0; c < ends.size() && c < cdata.size(); c++){
+               size_t start {c == 0 ? 0 : ends[c - 1] + 1};
+               cdata[c].insert(cdata[c].end(), text.data() + start, text.data() + ends[c]);
+               cdata[c].push_back('\n');
+          }
+     }
+}
+
+bool RowStore::keyless(void) const noexcept(true){
+     return std::find(keys.begin(), keys.end(), true) == keys.end();
+}
+
+int RowStore::findField(const Fields& tuple, size_t column) const noexcept(true){
+     // Tuples normally list the columns in the table order: try the same position first.
+     if(column < tuple.size() && get<FNAME>(tuple[column]) == columns[column]) 
+          return static_cast<int>(column);
+
+     for(size_t f = 0; f < tuple.size(); f++)
+          if(get<FNAME>(tuple[f]) == columns[column]) return static_cast<int>(f);
+
+     return -1;
+}
+
+bool RowStore::makeKey(const Fields& tuple, RowKey& key) const noexcept(false){
+     key.clear();
+     for(size_t c = 0; c < columns.size(); c++){
+          if(!keys[c]) continue;
+
+          int f {findField(tuple, c)};
+          if(f < 0 || get<FSTATE>(tuple[f]) == FIELD_NULL){
+               key.append("N;");
+               continue;
+          }
+          if(get<FSTATE>(tuple[f]) == FIELD_UNCHANGED) return false;
+
+          const string& value {get<FVALUE>(tuple[f])};
+          key.append("V").append(to_string(value.size())).append(":").append(value);
+     }
+     return key.size() != 0;
+}
+
+size_t RowStore::prefix(size_t slot) const noexcept(true){
+     size_t sum {0};
+     for(size_t i = slot; i > 0; i -= i & (~i + 1))
+          sum += fenwick[i];
+     return sum;
+}
+
+void RowStore::setLength(size_t slot, size_t len) noexcept(true){
+     size_t  idx    {slot + 1};
+
+     if(idx == fenwick.size()){
+          size_t low  {idx & (~idx + 1)};
+          fenwick.push_back(len + prefix(idx - 1) - prefix(idx - low));
+          total += len;
+          return;
+     }
+
+     size_t  old    {get<RTEXT>(slots[slot]).size()};
+     total          = total - old + len;
+     for( ; idx < fenwick.size(); idx += idx & (~idx + 1))
+          fenwick[idx] = fenwick[idx] - old + len;
+}
+
+size_t RowStore::findSlot(size_t offset, size_t& intra) const noexcept(true){
+     size_t  pos    {0},
+             step   {1};
+
+     while(step * 2 < fenwick.size()) step *= 2;
+
+     for(intra = offset; step != 0; step /= 2){
+          if(pos + step < fenwick.size() && fenwick[pos + step] <= intra){
+               pos   += step;
+               intra -= fenwick[pos];
+          }
+     }
+     return pos;
+}
+
+bool RowStore::put(const Fields& tuple, const Fields* oldKey) noexcept(false){
+     RowKey            key,
+                       prevKey;
+     bool              keyed     {!keyless()};
+
+     if(keyed){
+          if(!makeKey(tuple, key)) return false;
+          prevKey = key;
+          if(oldKey != nullptr && oldKey->size() != 0 && !makeKey(*oldKey, prevKey)) return false;
+     }
+
+     lock_guard<mutex> lock(mtxRows);
+
+     auto              prevIt    {keyed ? index.find(prevKey) : index.end()};
+     const Row*        prev      {prevIt != index.end() ? &slots[prevIt->second] : nullptr};
+     Row               row;
+     string&           text      {get<RTEXT>(row)};
+     vector<uint32_t>& ends      {get<RENDS>(row)};
+
+     for(size_t c = 0; c < columns.size(); c++){
+          int f {findField(tuple, c)};
+          if(f < 0) return false;
+
+          switch(get<FSTATE>(tuple[f])){
+               case FIELD_UNCHANGED:
+                     if(prev == nullptr) return false;
+                     text.append(get<RTEXT>(*prev), c == 0 ? 0 : get<RENDS>(*prev)[c - 1] + 1, 
+                                 get<RENDS>(*prev)[c] - (c == 0 ? 0 : get<RENDS>(*prev)[c - 1] + 1));
+               break;
+               case FIELD_VALUE:
+                     text.append(get<FVALUE>(tuple[f]));
+               break;
+               case FIELD_NULL:
+               default:
+               break;
+          }
+          ends.push_back(static_cast<uint32_t>(text.size()));
+          text.push_back(';');
+     }
+     text.push_back('\n');
+
+     size_t            slot      {slots.size()};
+
+     if(prevIt != index.end()){
+          slot = prevIt->second;
+          if(prevKey != key){
+               index.erase(prevIt);
+               auto dupIt {index.find(key)};
+               if(dupIt != index.end()){
+                    setLength(dupIt->second, 0);
+                    slots[dupIt->second] = Row();
+                    freeSlots.push_back(dupIt->second);
+                    rowNum--;
+               }
+          }
+     }else if(keyed && index.find(key) != index.end()){
+          slot = index[key];
+     }else if(freeSlots.size() != 0){
+          slot = freeSlots.back();
+          freeSlots.pop_back();
+          rowNum++;
+     }else{
+          slots.push_back(Row());
+          rowNum++;
+     }
+
+     setLength(slot, text.size());
+     slots[slot] = move(row);
+     if(keyed) index[key] = slot;
+
+     return true;
+}
+
+bool RowStore::erase(const Fields& oldKey) noexcept(false){
+     RowKey            key;
+
+     if(keyless() || !makeKey(oldKey, key)) return false;
+
+     lock_guard<mutex> lock(mtxRows);
+
+     auto              keyIt    {index.find(key)};
+     if(keyIt != index.end()){
+          setLength(keyIt->second, 0);
+          slots[keyIt->second] = Row();
+          freeSlots.push_back(keyIt->second);
+          index.erase(keyIt);
+          rowNum--;
+     }
+     return true;
+}
+
+void RowStore::clear(void) noexcept(true){
+     lock_guard<mutex> lock(mtxRows);
+
+     slots.clear();
+     freeSlots.clear();
+     index.clear();
+     fenwick.assign(1, 0);
+     total  = 0;
+     rowNum = 0;
+}
+
+size_t RowStore::memory(void) const noexcept(true){
+     lock_guard<mutex> lock(mtxRows);
+
+     // Approximated: the text of the rows plus the bookkeeping of every slot.
+     return total + slots.size() * (sizeof(Row) + columns.size() * sizeof(uint32_t) + 2 * sizeof(size_t)) +
+            index.size() * (sizeof(RowKey) + sizeof(size_t) + 2 * sizeof(void*));
+}
+
+size_t RowStore::read(char* buf, size_t len, size_t offset) const noexcept(false){
+     lock_guard<mutex> lock(mtxRows);
+
+     if(offset >= total) return 0;
+
+     size_t  intra   {0},
+             count   {0};
+
+     for(size_t slot = findSlot(offset, intra); slot < slots.size() && count < len; slot++, intra = 0){
+          const string& text  {get<RTEXT>(slots[slot])};
+          if(intra >= text.size()) continue;
+
+          size_t chunk {min(len - count, text.size() - intra)};
+          std::copy(text.data() + intra, text.data() + intra + chunk, buf + count);
+          count += chunk;
+     }
+     return count;
+}
+
+} // end namespace dbfsutils
@@ -0,0 +1,176 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+// Tests of the Arrow IPC writer: 'make check'. The expected file was read back with pyarrow;
+// with a path as argument the file is written there too, for a reader to check.
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include <stdint.h>
+
+#include <table_store.hpp>
+#include <arrow_ipc.hpp>
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+using std::ofstream;
+
+using dbfsutils::TableData;
+using dbfsutils::ArrowWriter;
+
+namespace{
+     int  failures  {0};
+
+     void check(bool cond, const string& what){
+          if(cond) return;
+          cerr << "FAIL: " << what << endl;
+          failures++;
+     }
+
+     int32_t int32At(const TableData& data, size_t pos){
+          int32_t  value  {0};
+          memcpy(&value, data.data() + pos, sizeof(value));
+          return value;
+     }
+
+     // id int4, name text, ok bool, ratio float8: "1;one;t;0.5", "2;;f;x", ";three\tx;;2.25".
+     // A value that can't be parsed, as an empty one, is null; an empty text is not.
+     const unsigned char  expected[]  {
+          0x41, 0x52, 0x52, 0x4f, 0x57, 0x31, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0x50, 0x01, 0x00, 0x00,
+          0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x18, 0x00, 0x16, 0x00, 0x15, 0x00,
+          0x10, 0x00, 0x04, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x01, 0x04, 0x00, 0x08, 0x00, 0x0c, 0x00,
+          0x0a, 0x00, 0x04, 0x00, 0x08, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x04, 0x00, 0x00, 0x00, 0xd8, 0x00, 0x00, 0x00, 0x98, 0x00, 0x00, 0x00, 0x5c, 0x00, 0x00, 0x00,
+          0x14, 0x00, 0x00, 0x00, 0x10, 0x00, 0x16, 0x00, 0x10, 0x00, 0x0f, 0x00, 0x0e, 0x00, 0x08, 0x00,
+          0x00, 0x00, 0x04, 0x00, 0x10, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00,
+          0x00, 0x00, 0x03, 0x01, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x08, 0x00, 0x06, 0x00,
+          0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00,
+          0x72, 0x61, 0x74, 0x69, 0x6f, 0x00, 0x00, 0x00, 0x10, 0x00, 0x14, 0x00, 0x10, 0x00, 0x0f, 0x00,
+          0x0e, 0x00, 0x08, 0x00, 0x00, 0x00, 0x04, 0x00, 0x10, 0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00,
+          0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x01, 0x10, 0x00, 0x00, 0x00, 0x04, 0x00, 0x04, 0x00,
+          0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x6f, 0x6b, 0x00, 0x00,
+          0x10, 0x00, 0x14, 0x00, 0x10, 0x00, 0x0f, 0x00, 0x0e, 0x00, 0x08, 0x00, 0x00, 0x00, 0x04, 0x00,
+          0x10, 0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x01,
+          0x10, 0x00, 0x00, 0x00, 0x04, 0x00, 0x04, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x04, 0x00, 0x00, 0x00, 0x6e, 0x61, 0x6d, 0x65, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x14, 0x00,
+          0x10, 0x00, 0x0f, 0x00, 0x0e, 0x00, 0x08, 0x00, 0x00, 0x00, 0x04, 0x00, 0x10, 0x00, 0x00, 0x00,
+          0x24, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x01, 0x1c, 0x00, 0x00, 0x00,
+          0x08, 0x00, 0x0c, 0x00, 0x08, 0x00, 0x07, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+          0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x69, 0x64, 0x00, 0x00,
+          0xff, 0xff, 0xff, 0xff, 0x28, 0x01, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x0c, 0x00, 0x16, 0x00, 0x14, 0x00, 0x13, 0x00, 0x0c, 0x00, 0x04, 0x00, 0x0c, 0x00, 0x00, 0x00,
+          0x68, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+          0x04, 0x00, 0x0a, 0x00, 0x18, 0x00, 0x0c, 0x00, 0x08, 0x00, 0x04, 0x00, 0x0a, 0x00, 0x00, 0x00,
+          0x14, 0x00, 0x00, 0x00, 0xa8, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x00, 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x38, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00,
+          0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+          0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
+          0x03, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x6f, 0x6e, 0x65, 0x74, 0x68, 0x72, 0x65, 0x65,
+          0x09, 0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe0, 0x3f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x40, 0x10, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x14, 0x00,
+          0x12, 0x00, 0x0c, 0x00, 0x08, 0x00, 0x04, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00,
+          0x2c, 0x00, 0x00, 0x00, 0x38, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00,
+          0x60, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x68, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x0c, 0x00, 0x0a, 0x00, 0x04, 0x00, 0x08, 0x00, 0x00, 0x00,
+          0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0xd8, 0x00, 0x00, 0x00,
+          0x98, 0x00, 0x00, 0x00, 0x5c, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x10, 0x00, 0x16, 0x00,
+          0x10, 0x00, 0x0f, 0x00, 0x0e, 0x00, 0x08, 0x00, 0x00, 0x00, 0x04, 0x00, 0x10, 0x00, 0x00, 0x00,
+          0x20, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x01, 0x18, 0x00, 0x00, 0x00,
+          0x00, 0x00, 0x06, 0x00, 0x08, 0x00, 0x06, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00,
+          0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x00, 0x00, 0x00,
+          0x10, 0x00, 0x14, 0x00, 0x10, 0x00, 0x0f, 0x00, 0x0e, 0x00, 0x08, 0x00, 0x00, 0x00, 0x04, 0x00,
+          0x10, 0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x01,
+          0x10, 0x00, 0x00, 0x00, 0x04, 0x00, 0x04, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x02, 0x00, 0x00, 0x00, 0x6f, 0x6b, 0x00, 0x00, 0x10, 0x00, 0x14, 0x00, 0x10, 0x00, 0x0f, 0x00,
+          0x0e, 0x00, 0x08, 0x00, 0x00, 0x00, 0x04, 0x00, 0x10, 0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00,
+          0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x01, 0x10, 0x00, 0x00, 0x00, 0x04, 0x00, 0x04, 0x00,
+          0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x6e, 0x61, 0x6d, 0x65,
+          0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x14, 0x00, 0x10, 0x00, 0x0f, 0x00, 0x0e, 0x00, 0x08, 0x00,
+          0x00, 0x00, 0x04, 0x00, 0x10, 0x00, 0x00, 0x00, 0x24, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00,
+          0x00, 0x00, 0x02, 0x01, 0x1c, 0x00, 0x00, 0x00, 0x08, 0x00, 0x0c, 0x00, 0x08, 0x00, 0x07, 0x00,
+          0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+          0x02, 0x00, 0x00, 0x00, 0x69, 0x64, 0x00, 0x00, 0x70, 0x01, 0x00, 0x00, 0x41, 0x52, 0x52, 0x4f,
+          0x57, 0x31
+     };
+}
+
+int main(int argc, char** argv){
+     const char   *rows[][4]  {{"1", "one",      "t", "0.5"},
+                               {"2", "",         "f", "x"},
+                               {"",  "three\tx", "",  "2.25"}};
+     ArrowWriter  writer({"id", "name", "ok", "ratio"},
+                         {ArrowWriter::PG_INT4, 25, ArrowWriter::PG_BOOL, ArrowWriter::PG_FLOAT8});
+     TableData    out;
+
+     for(auto &row : rows){
+          for(size_t c = 0; c < 4; c++) writer.append(c, row[c], strlen(row[c]));
+          writer.endRow();
+     }
+     writer.write(out);
+
+     // File: magic padded to 8, schema and batch messages, footer, footer length, magic.
+     check(out.size() > 24 && out.size() % 8 == 2, "file size");
+     check(memcmp(out.data(), "ARROW1\0\0", 8) == 0, "leading magic");
+     check(memcmp(out.data() + out.size() - 6, "ARROW1", 6) == 0, "trailing magic");
+     check(int32At(out, 8) == -1 && int32At(out, 12) % 8 == 0, "schema message marker and length");
+
+     size_t   batch   {16 + static_cast<size_t>(int32At(out, 12))};
+     check(batch < out.size() && int32At(out, batch) == -1 && int32At(out, batch + 4) % 8 == 0,
+           "batch message marker and length");
+
+     int32_t  footer  {int32At(out, out.size() - 10)};
+     check(footer > 0 && static_cast<size_t>(footer) + 10 < out.size() &&
+           (out.size() - 10 - footer) % 8 == 0, "footer length");
+
+     check(out.size() == sizeof(expected) && memcmp(out.data(), expected, sizeof(expected)) == 0,
+           "bytes of the known-good file");
+
+     if(argc > 1){
+          ofstream  file(argv[1], std::ios::binary);
+          file.write(out.data(), static_cast<std::streamsize>(out.size()));
+          check(file.good(), string("write ") + argv[1]);
+     }
+
+     if(failures != 0){
+          cerr << "test_arrow_ipc: " << failures << " failures" << endl;
+          return 1;
+     }
+     return 0;
+}
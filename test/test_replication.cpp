@@ -0,0 +1,102 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+// Tests of the parser of the changes decoded by test_decoding: 'make check'.
+
+#include <string>
+#include <iostream>
+
+#include <replication.hpp>
+
+using std::string;
+using std::cerr;
+using std::endl;
+using std::get;
+
+using dbfsutils::Changes;
+using dbfsutils::PsqlReplication;
+using dbfsutils::CTABLE;
+using dbfsutils::COP;
+using dbfsutils::COLD;
+using dbfsutils::CNEW;
+using dbfsutils::FVALUE;
+using dbfsutils::FSTATE;
+using dbfsutils::FIELD_NULL;
+using dbfsutils::CHANGE_INSERT;
+using dbfsutils::CHANGE_UPDATE;
+using dbfsutils::CHANGE_DELETE;
+using dbfsutils::CHANGE_TRUNCATE;
+using dbfsutils::CHANGE_UNKNOWN;
+
+namespace{
+     int  failures  {0};
+
+     void check(bool cond, const string& what){
+          if(cond) return;
+          cerr << "FAIL: " << what << endl;
+          failures++;
+     }
+
+     bool parse(const string& record, Changes& changes){
+          changes.clear();
+          return PsqlReplication::parseChange(record.data(), record.size(), changes);
+     }
+}
+
+int main(void){
+     Changes  changes;
+
+     check(parse("table public.t: INSERT: id[integer]:1 name[text]:'it''s' note[text]:null", changes) &&
+           changes.size() == 1 && get<CTABLE>(changes[0]) == "public.t" && get<COP>(changes[0]) == CHANGE_INSERT &&
+           get<CNEW>(changes[0]).size() == 3 && get<FVALUE>(get<CNEW>(changes[0])[1]) == "it's" &&
+           get<FSTATE>(get<CNEW>(changes[0])[2]) == FIELD_NULL, "insert");
+     check(parse("table public.t: UPDATE: old-key: id[integer]:1 new-tuple: id[integer]:2 name[text]:'b'", changes) &&
+           changes.size() == 1 && get<COP>(changes[0]) == CHANGE_UPDATE &&
+           get<COLD>(changes[0]).size() == 1 && get<CNEW>(changes[0]).size() == 2, "update");
+     check(parse("table \"My Schema\".\"t,1\": DELETE: id[integer]:1", changes) &&
+           changes.size() == 1 && get<CTABLE>(changes[0]) == "\"My Schema\".\"t,1\"" && 
+           get<COP>(changes[0]) == CHANGE_DELETE, "delete, quoted names");
+     check(parse("table public.t: DELETE: (no-tuple-data)", changes) &&
+           changes.size() == 1 && get<COP>(changes[0]) == CHANGE_UNKNOWN, "delete without a key");
+
+     check(parse("table public.t: TRUNCATE: (no-flags)", changes) &&
+           changes.size() == 1 && get<CTABLE>(changes[0]) == "public.t" && get<COP>(changes[0]) == CHANGE_TRUNCATE,
+           "truncate");
+     check(parse("table public.a, public.b, \"x, y\".c: TRUNCATE: restart_seqs cascade", changes) &&
+           changes.size() == 3 && get<CTABLE>(changes[0]) == "public.a" && get<CTABLE>(changes[1]) == "public.b" &&
+           get<CTABLE>(changes[2]) == "\"x, y\".c" && get<COP>(changes[0]) == CHANGE_TRUNCATE &&
+           get<COP>(changes[1]) == CHANGE_TRUNCATE && get<COP>(changes[2]) == CHANGE_TRUNCATE, "truncate of several tables");
+
+     // A record of a table that can't be read is a change of unknown kind: the tables read are reloaded.
+     check(parse("table public.a, public.b TRUNCATE", changes) && changes.size() == 2 &&
+           get<CTABLE>(changes[1]) == "public.b" && get<COP>(changes[0]) == CHANGE_UNKNOWN &&
+           get<COP>(changes[1]) == CHANGE_UNKNOWN, "unreadable list of tables");
+     check(parse("table public.t: MERGE: id[integer]:1", changes) && changes.size() == 1 &&
+           get<COP>(changes[0]) == CHANGE_UNKNOWN, "unknown operation");
+     check(parse("table public.t: INSERT: id[integer:1", changes) && changes.size() == 1 &&
+           get<COP>(changes[0]) == CHANGE_UNKNOWN && get<CNEW>(changes[0]).size() == 0, "unreadable tuple");
+
+     check(!parse("message: transactional: 1 prefix: p, sz: 1 content:x", changes) && changes.size() == 0, 
+           "not a change of a table");
+     check(!parse("table ", changes) && changes.size() == 0, "no table");
+
+     if(failures != 0){
+          cerr << "test_replication: " << failures << " failures" << endl;
+          return 1;
+     }
+     return 0;
+}
@@ -0,0 +1,149 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+// Tests of the row filters and of the value indexes: 'make check'.
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <memory>
+
+#include <table_store.hpp>
+#include <row_filter.hpp>
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+using std::make_shared;
+
+using dbfsutils::TableData;
+using dbfsutils::RowIndex;
+using dbfsutils::RowNum;
+using dbfsutils::RowFilter;
+using dbfsutils::ValueIndex;
+using dbfsutils::FlatStore;
+using dbfsutils::copyEscape;
+
+namespace{
+     int  failures  {0};
+
+     void check(bool cond, const string& what){
+          if(cond) return;
+          cerr << "FAIL: " << what << endl;
+          failures++;
+     }
+
+     // The rows as rendered by the loaders: every field followed by ';', a row by '\n'.
+     void render(const vector<vector<string>>& rows, bool escaped, TableData& data, RowIndex& index){
+          for(auto &row : rows){
+               for(auto &value : row){
+                    string  field  {escaped ? copyEscape(value) : value};
+                    data.insert(data.end(), field.begin(), field.end());
+                    data.push_back(';');
+               }
+               data.push_back('\n');
+               index.push(data.size());
+          }
+     }
+
+     RowNum filter(RowFilter::FILTERMODE mode, const string& pattern, size_t column, bool escaped,
+                   const TableData& data, const RowIndex& index, string& result){
+          TableData  selected;
+          RowFilter  rowFilter(mode, pattern, column, escaped);
+          RowNum     rows  {rowFilter.select(data.data(), index, selected)};
+          result.assign(selected.begin(), selected.end());
+          return rows;
+     }
+}
+
+int main(void){
+     const vector<vector<string>>  rows  {{"1", "plain"},
+                                          {"2", "tab\there"},
+                                          {"3", "back\\slash"},
+                                          {"4", "semi;colon"},
+                                          {"5", "line\nbreak"},
+                                          {"6", "nbreak"}};
+     string                        result;
+
+     check(copyEscape("a\\b;c\td\ne") == "a\\\\b\\;c\\td\\ne", "copyEscape");
+
+     // Loaded with COPY: the values are escaped in the table, not in the patterns.
+     {
+          TableData  data;
+          RowIndex   index;
+          render(rows, true, data, index);
+
+          check(filter(RowFilter::FILTER_FIELD, "tab\there", 1, true, data, index, result) == 1 &&
+                result == "2;tab\\there;\n", "COPY: field with a tab");
+          check(filter(RowFilter::FILTER_FIELD, "back\\slash", 1, true, data, index, result) == 1 &&
+                result == "3;back\\\\slash;\n", "COPY: field with a backslash");
+          check(filter(RowFilter::FILTER_FIELD, "semi;colon", 1, true, data, index, result) == 1,
+                "COPY: field with a separator");
+          check(filter(RowFilter::FILTER_FIELD, "line\nbreak", 1, true, data, index, result) == 1 &&
+                result == "5;line\\nbreak;\n", "COPY: field with a new line");
+          check(filter(RowFilter::FILTER_FIELD, "tab\\there", 1, true, data, index, result) == 0,
+                "COPY: escaped pattern doesn't match");
+          check(filter(RowFilter::FILTER_FIELD, "\\N", 1, true, data, index, result) == 0,
+                "COPY: \\N isn't a null");
+
+          // 'nbreak' is in the escaped text of row 5 too, inside its escape.
+          check(filter(RowFilter::FILTER_TEXT, "nbreak", 0, true, data, index, result) == 1 &&
+                result == "6;nbreak;\n", "COPY: grep skips matches inside an escape");
+          check(filter(RowFilter::FILTER_TEXT, "\n", 0, true, data, index, result) == 1 &&
+                result == "5;line\\nbreak;\n", "COPY: grep for a new line");
+          check(filter(RowFilter::FILTER_TEXT, "\\", 0, true, data, index, result) == 1 &&
+                result == "3;back\\\\slash;\n", "COPY: grep for a backslash");
+
+          auto        store  {make_shared<FlatStore>(TableData(data), index.rows())};
+          ValueIndex  byValue("value", 1, true);
+          TableData   selected;
+          byValue.build(data.data(), index);
+          check(byValue.find(*store, index, "back\\slash", selected) == 1 &&
+                string(selected.begin(), selected.end()) == "3;back\\\\slash;\n", "COPY: index, backslash");
+          selected.clear();
+          check(byValue.find(*store, index, "line\nbreak", selected) == 1, "COPY: index, new line");
+          selected.clear();
+          check(byValue.find(*store, index, "line\\nbreak", selected) == 0, "COPY: index, escaped value");
+     }
+
+     // Loaded with SELECT: the values are as they are, a separator in a value can't be told apart.
+     {
+          TableData  data;
+          RowIndex   index;
+          render(rows, false, data, index);
+
+          check(filter(RowFilter::FILTER_FIELD, "tab\there", 1, false, data, index, result) == 1,
+                "SELECT: field with a tab");
+          check(filter(RowFilter::FILTER_FIELD, "back\\slash", 1, false, data, index, result) == 1,
+                "SELECT: field with a backslash");
+          check(filter(RowFilter::FILTER_TEXT, "nbreak", 0, false, data, index, result) == 1,
+                "SELECT: grep");
+
+          auto        store  {make_shared<FlatStore>(TableData(data), index.rows())};
+          ValueIndex  byValue("value", 1, false);
+          TableData   selected;
+          byValue.build(data.data(), index);
+          check(byValue.find(*store, index, "tab\there", selected) == 1, "SELECT: index");
+     }
+
+     if(failures != 0){
+          cerr << "test_row_filter: " << failures << " failures" << endl;
+          return 1;
+     }
+     return 0;
+}
@@ -0,0 +1,145 @@
+// -----------------------------------------------------------------
+// Dbfs - Cache in RAM the content of DB tables and mount the cache like a file system.
+// Copyright (C) 2017  Gabriele Bonacini
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------
+
+// Tests of the snapshots: 'make check'. A snapshot is saved, restored, then restored again 
+// after changing one field of it at a time: every change must be rejected.
+
+#include <string>
+#include <iostream>
+#include <memory>
+#include <functional>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <stdint.h>
+
+#include <syslog.hpp>
+#include <table_store.hpp>
+#include <db_utils.hpp>
+#include <snapshot.hpp>
+
+using std::string;
+using std::cerr;
+using std::endl;
+using std::get;
+using std::make_shared;
+using std::function;
+
+using syslogwrp::Syslog;
+using dbfsutils::TableList;
+using dbfsutils::TableAttr;
+using dbfsutils::TableData;
+using dbfsutils::FlatStore;
+using dbfsutils::Snapshot;
+using dbfsutils::RNUM;
+using dbfsutils::DATA;
+using dbfsutils::VERS;
+
+namespace{
+     // Header: magic, format, tables, length; then the entry of the first table.
+     enum LAYOUT   { HEADER_LENGTH=16, ENTRY=24, ENTRY_NAMELEN=24, ENTRY_VERSIONLEN=32, 
+                     ENTRY_ROWS=40, ENTRY_OFFSET=48, ENTRY_SIZE=56 };
+
+     const string  rows      {"1;one;\n2;two;\n"};
+     int           failures  {0};
+
+     void check(bool cond, const string& what){
+          if(cond) return;
+          cerr << "FAIL: " << what << endl;
+          failures++;
+     }
+
+     uint64_t peek(const string& path, off_t pos){
+          uint64_t  value  {0};
+          int       fd     {open(path.c_str(), O_RDONLY)};
+          if(pread(fd, &value, sizeof(value), pos) != sizeof(value)) value = 0;
+          close(fd);
+          return value;
+     }
+
+     void poke(const string& path, off_t pos, uint64_t value){
+          int  fd  {open(path.c_str(), O_WRONLY)};
+          if(pwrite(fd, &value, sizeof(value), pos) != sizeof(value)) check(false, "write " + path);
+          close(fd);
+     }
+
+     // Saves a fresh snapshot, changes it, and tells whether it's still restored.
+     bool restored(const string& path, const TableList& db, Syslog* slog, function<void(void)> change){
+          TableList  back;
+          Snapshot::save(path, db, slog);
+          change();
+          return Snapshot::restore(path, back, slog);
+     }
+}
+
+int main(void){
+     Syslog     slog("test_snapshot", LOG_PID, LOG_USER);
+     char       tmpl[]  {"/tmp/test_snapshot.XXXXXX"};
+     int        fd      {mkstemp(tmpl)};
+     string     path    {tmpl};
+     TableList  db,
+                back;
+
+     slog.setPriority(LOG_UPTO(LOG_EMERG));
+     if(fd == -1){
+          cerr << "test_snapshot: can't create " << path << endl;
+          return 1;
+     }
+     close(fd);
+
+     TableAttr &attr {db["public.t1"]};
+     get<RNUM>(attr) = 2;
+     get<DATA>(attr) = make_shared<FlatStore>(TableData(rows.begin(), rows.end()), 2);
+     get<VERS>(attr) = "v1";
+
+     Snapshot::save(path, db, &slog);
+     check(Snapshot::restore(path, back, &slog) && back.size() == 1 && get<RNUM>(back["public.t1"]) == 2 &&
+           get<VERS>(back["public.t1"]) == "v1", "restore");
+     if(back.size() == 1 && get<DATA>(back["public.t1"])){
+          TableData  buf(rows.size());
+          size_t     count  {get<DATA>(back["public.t1"])->read(buf.data(), buf.size(), 0)};
+          check(string(buf.data(), count) == rows, "restored rows");
+     }
+
+     const uint64_t  length  {peek(path, HEADER_LENGTH)};
+
+     check(!restored(path, db, &slog, [&]{ check(truncate(path.c_str(), length - 8) == 0, "truncate"); }), 
+           "truncated file");
+     check(!restored(path, db, &slog, [&]{ 
+                check(truncate(path.c_str(), length + 8) == 0, "extend");
+                poke(path, HEADER_LENGTH, length + 8); }), "bytes after the last table");
+     check(!restored(path, db, &slog, [&]{ poke(path, ENTRY_NAMELEN, 1ULL << 40); }), "name past the end");
+     check(!restored(path, db, &slog, [&]{ poke(path, ENTRY_NAMELEN, length); }), "name as long as the file");
+     // aligned(name) + version wraps to a small number: it used to pass the check.
+     check(!restored(path, db, &slog, [&]{ poke(path, ENTRY_VERSIONLEN, UINT64_MAX - 7); }), "version wrapping around");
+     check(!restored(path, db, &slog, [&]{ poke(path, ENTRY_VERSIONLEN, UINT64_MAX); }), "version past the end");
+     check(!restored(path, db, &slog, [&]{ poke(path, ENTRY_OFFSET, peek(path, ENTRY_OFFSET) + 8); }), "wrong offset");
+     check(!restored(path, db, &slog, [&]{ poke(path, ENTRY_SIZE, rows.size() + 8); }), "data past the end");
+     check(!restored(path, db, &slog, [&]{ poke(path, ENTRY_SIZE, UINT64_MAX); }), "data wrapping around");
+     check(!restored(path, db, &slog, [&]{ poke(path, ENTRY_ROWS, rows.size() + 1); }), "more rows than bytes");
+     check(restored(path, db, &slog, []{}), "restore after the changes");
+
+     unlink(path.c_str());
+
+     if(failures != 0){
+          cerr << "test_snapshot: " << failures << " failures" << endl;
+          return 1;
+     }
+     return 0;
+}